@@ -53,10 +53,88 @@
 // ------------------------------------------------------------------------------
 
 #include "autopilot_interface.h"
+#include "replay.h"
 
 bool stable = false, updateellipse = false, getlocalposition = false, drop = false;
-int TargetNum = 0;
+int TargetNum = -1;
 coordinate droptarget;
+
+static std::mutex vision_frame_mutex;
+static uint64_t vision_frame_id = 0, vision_capture_us = 0;
+
+void publish_vision_frame(uint64_t frame_id, uint64_t capture_us)
+{
+	std::lock_guard<std::mutex> lock(vision_frame_mutex);
+	vision_frame_id = frame_id;
+	vision_capture_us = capture_us;
+}
+
+bool latest_vision_frame(uint64_t& frame_id, uint64_t& capture_us)
+{
+	std::lock_guard<std::mutex> lock(vision_frame_mutex);
+	frame_id = vision_frame_id;
+	capture_us = vision_capture_us;
+	return capture_us != 0;
+}
+
+std::mutex target_mutex;
+
+bool get_target(int num, target& t)
+{
+	std::lock_guard<std::mutex> lock(target_mutex);
+	if (num < 0 || num >= int(target_ellipse_position.size()))
+		return false;
+	t = target_ellipse_position[num];
+	return true;
+}
+
+int target_decision(int num)
+{
+	std::lock_guard<std::mutex> lock(target_mutex);
+	if (num < 0 || num >= int(target_ellipse_position.size()))
+		return -1;
+	const target& t = target_ellipse_position[num];
+	if (target_tracker.decided_T(t))
+		return 1;
+	if (target_tracker.decided_F(t))
+		return 0;
+	return -1;
+}
+
+size_t count_T()
+{
+	std::lock_guard<std::mutex> lock(target_mutex);
+	return ellipse_T.size();
+}
+
+static std::mutex decision_mutex;
+static Replay_Clock *decision_clock = NULL;
+static vector<TF_Decision> decisions;
+
+void set_decision_clock(Replay_Clock *clock)
+{
+	std::lock_guard<std::mutex> lock(decision_mutex);
+	decision_clock = clock;
+}
+
+static void record_decision(int num, bool T)
+{
+	std::lock_guard<std::mutex> lock(decision_mutex);
+	for (size_t i = 0; i < decisions.size(); i++)
+		if (decisions[i].num == num)
+			return;
+	TF_Decision d;
+	d.num = num;
+	d.T = T;
+	d.time_us = decision_clock ? decision_clock->now() : get_time_usec();
+	decisions.push_back(d);
+}
+
+vector<TF_Decision> tf_decisions()
+{
+	std::lock_guard<std::mutex> lock(decision_mutex);
+	return decisions;
+}
 // ----------------------------------------------------------------------------------
 //   Time
 // ------------------- ---------------------------------------------------------------
@@ -68,6 +146,31 @@ get_time_usec()
 	return _time_stamp.tv_sec*1000000 + _time_stamp.tv_usec;
 }
 
+// ----------------------------------------------------------------------------------
+//   单调时钟(us)，不受系统时间调整影响，用于图像采集时刻和延迟统计
+// ----------------------------------------------------------------------------------
+uint64_t
+get_monotonic_usec()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec*1000000 + ts.tv_nsec/1000;
+}
+
+// ----------------------------------------------------------------------------------
+//   进程常驻内存(kB)，读取 /proc/self/statm
+// ----------------------------------------------------------------------------------
+long
+get_rss_kb()
+{
+	long pages = 0, resident = 0;
+	FILE* f = fopen("/proc/self/statm", "r");
+	if (f == NULL) return -1;
+	if (fscanf(f, "%ld %ld", &pages, &resident) != 2) resident = -1;
+	fclose(f);
+	return resident < 0 ? -1 : resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
 // -------------------------------------------------------------------------------
 //  计算三维距离
 // -------------------------------------------------------------------------------
@@ -325,6 +428,21 @@ update_local_setpoint(mavlink_set_position_target_local_ned_t setpoint)
 	write_local_setpoint();
 }
 
+// 按视觉结果计算的设定点：frame_id、capture_us为计算时所用目标位置来自的帧(latest_vision_frame)，
+// 记录该帧及其采集到设定点发出的延迟；起飞、航点、悬停等设定点用上面的版本，不计入延迟
+void
+Autopilot_Interface::
+update_local_setpoint(mavlink_set_position_target_local_ned_t setpoint, uint64_t frame_id, uint64_t capture_us)
+{
+	update_local_setpoint(setpoint);
+	if (capture_us == 0)
+		return;
+	uint64_t latency = get_monotonic_usec() - capture_us;
+	setpoint_frame_id = frame_id;
+	setpoint_latency_us = latency;
+	setpoint_latency.add(latency);
+}
+
 
 
 // ------------------------------------------------------------------------------
@@ -1378,6 +1496,9 @@ Throw(float yaw,int Tnum)
 
 	while (drop)
 	{
+        //投放前的对准按droptarget计算，记下它来自哪一帧
+        uint64_t sp_frame, sp_capture;
+        latest_vision_frame(sp_frame, sp_capture);
         float locx = droptarget.x;
         float locy = droptarget.y;
 		mavlink_local_position_ned_t pos = current_messages.local_position_ned;
@@ -1397,7 +1518,7 @@ Throw(float yaw,int Tnum)
 		set_yaw(yaw, // [rad]
 				locsp);
 		// SEND THE COMMAND
-		update_local_setpoint(locsp);
+		update_local_setpoint(locsp, sp_frame, sp_capture);
 		mavlink_local_position_ned_t locpos = current_messages.local_position_ned;
 
         if ((adisx < 10)&&(adisy < 10))
@@ -1475,7 +1596,9 @@ ThrowF(float yaw,target* targetF)
         TF++;
         if (TF==10)
         {
-            int TplusF = target_ellipse_position[TargetNum].T_N + target_ellipse_position[TargetNum].F_N;
+            target t;
+            get_target(TargetNum, t);
+            int TplusF = t.T_N + t.F_N;
             if(TplusF <= 5 )
             {
                 break;
@@ -1491,7 +1614,7 @@ ThrowF(float yaw,target* targetF)
         }
 
     }
-    if (target_ellipse_position[TargetNum].T_N >= 50)
+    if (target_decision(TargetNum) == 1)
     {
         T = Throw(yaw,2);
     }
@@ -1666,9 +1789,21 @@ start_WL_write_thread(void *args)
 // ------------------------------------------------------------------------------
 //  将当前时刻看到的所有可能为目标的椭圆存放在容器中
 // ------------------------------------------------------------------------------
-void possible_ellipse(Autopilot_Interface& api, vector<coordinate>& ellipse_out, vector<target>& target_ellipse){
-    float dis = 5;//在室外的参数圆心相距9米内都算一个圆
-//	float dis = 0.05;//在室内测试用0.05
+// 识别前把椭圆关联到已有目标(与possible_ellipse相同的门限判断)，识别缓存按目标序号查找
+void associate_targets(Autopilot_Interface& api, vector<coordinate>& ellipse_out, const vector<target>& target_ellipse, Target_Grid& grid, uint64_t stamp_us){
+    if (grid.get_indexed() != target_ellipse.size())
+        grid.rebuild(target_ellipse);
+    float h = target_height(api);
+    for (auto &p:ellipse_out) {
+        realtarget(api, p, p.locx, p.locy);
+        p.target = target_tracker.associate(target_ellipse, grid, p.locx, p.locy, h, stamp_us);
+    }
+}
+
+void possible_ellipse(Autopilot_Interface& api, vector<coordinate>& ellipse_out, vector<target>& target_ellipse, Target_Grid& grid, uint64_t stamp_us){
+    if (grid.get_indexed() != target_ellipse.size())
+        grid.rebuild(target_ellipse);
+    float h = target_height(api);
     for (auto &p:ellipse_out) {
     	float x_l, y_l, c_x, c_y, x_r, y_r;
     	uint16_t hdg;
@@ -1680,101 +1815,41 @@ void possible_ellipse(Autopilot_Interface& api, vector<coordinate>& ellipse_out,
         hdg = api.current_messages.global_position_int.hdg;
         x_r = c_x * cos(hdg * 3.1415926 / 180 / 100) - c_y * sin(hdg * 3.1415926 / 180 / 100);//单位是:像素
         y_r = c_y * cos(hdg * 3.1415926 / 180 / 100) + c_x * sin(hdg * 3.1415926 / 180 / 100);
-    	if (target_ellipse.size() == 0) {
-                target t;
-                t.locx = p.locx;
-                t.locy = p.locy;
-                t.a = p.a;
-                t.x = x_r;
-                t.y = y_r;
-                if (p.flag == 1)
-                    t.T_N = 1;
-                else if (p.flag == 0)
-                    t.F_N = 1;
-                else {}
-
-                t.possbile = (float) t.T_N / (float) (t.T_N + t.F_N + 0.001);
-                target_ellipse.push_back(t);
-                continue;
-            }
-            if(stable == true || updateellipse == true) {
-				for (auto i = 0; i < target_ellipse.size(); i++){
-					if (abs(p.locx - target_ellipse[i].locx) < dis &&
-						abs(p.locy - target_ellipse[i].locy) < dis) {
-						target_ellipse[i].locx = p.locx;
-						target_ellipse[i].locy = p.locy;
-						target_ellipse[i].a = p.a;
-						target_ellipse[i].x = x_r;
-						target_ellipse[i].y = y_r;
-						if (p.flag == 1)
-							target_ellipse[i].T_N = target_ellipse[i].T_N + 1;
-						else if (p.flag == 0)
-							target_ellipse[i].F_N = target_ellipse[i].F_N + 1;
-						else {}
-						target_ellipse[i].possbile =
-								(float) target_ellipse[i].T_N /
-								(float) (target_ellipse[i].T_N + target_ellipse[i].F_N + 0.001);
-						break;
-					} else
-						continue;
-			}
-            } else {
-				for (auto i = 0; i < target_ellipse.size(); i++) {
-					if (abs(p.locx - target_ellipse[i].locx) < dis &&
-						abs(p.locy - target_ellipse[i].locy) < dis) {
-						target_ellipse[i].locx = p.locx;
-						target_ellipse[i].locy = p.locy;
-						target_ellipse[i].a = p.a;
-						target_ellipse[i].x = x_r;
-						target_ellipse[i].y = y_r;
-						if (p.flag == 1)
-							target_ellipse[i].T_N = target_ellipse[i].T_N + 1;
-						else if (p.flag == 0)
-							target_ellipse[i].F_N = target_ellipse[i].F_N + 1;
-						else {}
-						target_ellipse[i].possbile =
-								(float) target_ellipse[i].T_N / (float) (target_ellipse[i].T_N + target_ellipse[i].F_N + 0.001);
-						break;
-					} else if (i != (target_ellipse.size() - 1)) {
-						continue;
-					} else {
-						target t;
-						t.locx = p.locx;
-						t.locy = p.locy;
-						t.a = p.a;
-						t.x = x_r;
-						t.y = y_r;
-						if (p.flag == 1)
-							t.T_N = 1;
-						else if (p.flag == 0)
-							t.F_N = 1;
-						else {}
-						t.possbile = (float) t.T_N / (float) (t.T_N + t.F_N + 0.001);
-						target_ellipse.push_back(t);
-						break;
-					}
-				}
-			}
+        //门限内马氏距离最近的目标，位置和T/F概率由target_tracker更新
+        int i = target_tracker.associate(target_ellipse, grid, p.locx, p.locy, h, stamp_us);
+        if (i >= 0) {
+            target_tracker.correct(target_ellipse, grid, i, p, h, stamp_us);
+        } else if (target_ellipse.size() == 0 || !(stable == true || updateellipse == true)) {
+            //识别和更新目标期间不增加新目标
+            i = target_tracker.birth(target_ellipse, grid, p, h, stamp_us);
+        } else
+            continue;
+        target &t = target_ellipse[i];
+        t.a = p.a;
+        t.x = x_r;
+        t.y = y_r;
     }
-    nearellipse(api, target_ellipse);
+    //超时未再观测到的暂定目标(偶然的误检)删除
+    target_tracker.prune(target_ellipse, grid, stamp_us);
 }
 void resultTF(Autopilot_Interface& api, vector<target>& ellipse_in, vector<target>& ellipse_1, vector<target>& ellipse_0){
 //	float possobile = 0.5, dis = 0.05;//室内测试设置0.5，0.05， 室外待定
 //	uint32_t num = 10;//室内测试设置10，室外待定
-	float possobile = 0.4, dis = 5;//室外测试：识别概率大于0.4都算作T，两圆圆心相距9米内都算一个圆
-	uint32_t num = 50;//室外测试：识别次数大于50次即可进行TF判断。
+	float dis = 5;//室外测试：两圆圆心相距5米内都算一个圆
+	//T/F的后验概率足够确定(target_tracker的decide_logodds)即可判断，不再要求固定的识别次数
 	int temp;
-	if(ellipse_in.size() == 0){
-
+	if(TargetNum < 0)
+		return;
+	//编号只增不重复使用，超出列表范围只能是错误，不能换成别的目标判断
+	if(TargetNum >= int(ellipse_in.size())){
+		printf("resultTF: target %d not in the list (%u targets)\n", TargetNum, (unsigned)ellipse_in.size());
+		return;
 	} else {
-        if(ellipse_in.size() == TargetNum ){
-            temp = TargetNum - 1;
-        } else{
-            temp = TargetNum;
-        }
+        temp = TargetNum;
 	    target p = ellipse_in[temp];
-        if (p.possbile > possobile && p.T_N > num) {
+        if (target_tracker.decided_T(p)) {
             stable = false;
+            record_decision(temp, true);
             if (ellipse_1.size() == 0) {
                 p.lat = api.current_messages.global_position_int.lat;
                 p.lon = api.current_messages.global_position_int.lon;
@@ -1795,8 +1870,9 @@ void resultTF(Autopilot_Interface& api, vector<target>& ellipse_in, vector<targe
                 }
 
             }
-        } else if (p.possbile < possobile && p.F_N > num) {
+        } else if (target_tracker.decided_F(p)) {
             stable = false;
+            record_decision(temp, false);
             if (ellipse_0.size() == 0) {
                 p.lat = api.current_messages.global_position_int.lat;
                 p.lon = api.current_messages.global_position_int.lon;
@@ -1855,10 +1931,14 @@ void getdroptarget(Autopilot_Interface& api, coordinate& droptarget, vector<coor
     }
 }
 
-void realtarget(Autopilot_Interface& api, coordinate& cam, float& x_l, float& y_l){
+int32_t target_height(Autopilot_Interface& api){
     int32_t h = -api.current_messages.local_position_ned.z;
     int32_t h_diff = -12;//目标高度比起飞高度低了5米
-            h = h + h_diff;
+    return h + h_diff;
+}
+
+void realtarget(Autopilot_Interface& api, coordinate& cam, float& x_l, float& y_l){
+    int32_t h = target_height(api);
 //        int32_t h = 25;//桌子高度0.74M
     uint16_t hdg = api.current_messages.global_position_int.hdg;
 //        uint16_t hdg = 0;//设置机头方向为正北
@@ -1918,6 +1998,41 @@ void OptimizEllipse(vector<Ellipse> &ellipse_out, vector<Ellipse> &ellipses_in){
 ellipse_out = e0;
 
 }
+void BuildCandidateFilters(CCandidateFilterChain& chain, CEllipseDetectorYaed* yaed, const CandidateFilterParams& params, Mat3b& frame){
+	yaed->SetTargetColorRanges(params.hsvBlue, params.hsvRed);
+	yaed->SetTargetColorWindows(params.rectWindows);
+
+	/***************************外接矩形需在图像内********************************************/
+	chain.AddStage("bounds", 0.5f, [&frame](const Ellipse& e){
+		int x_l = e._xc - e._a;
+		int y_l = e._yc - e._b;
+		int width_roi = abs(2 * e._a);
+		int height_roi = abs(2 * e._b);
+		return (x_l >= 0) && (y_l >= 0) && ((x_l + width_roi) <= frame.cols) && ((y_l + height_roi) <= frame.rows);
+	});
+
+	/***************************去掉评分不佳的椭圆********************************************/
+	float score = params.fMinScore;
+	chain.AddStage("score", 1.f, [score](const Ellipse& e){
+		return e._score >= score;
+	});
+
+	/***************************去掉偏心率过大的椭圆********************************************/
+	float ecc = params.fMaxEccentricity;
+	chain.AddStage("eccentricity", 1.f, [ecc](const Ellipse& e){
+		return ((e._a - e._b) / e._a) <= ecc;
+	});
+
+	/***************************目标颜色，整帧HSV分类在第一个候选到达时进行********************************************/
+	chain.AddStage("color", 50.f, [yaed](const Ellipse& e){
+		Ellipse ell(e);
+		Rect roi(int(e._xc - e._a), int(e._yc - e._b), int(abs(2 * e._a)), int(abs(2 * e._b)));
+		return yaed->computetargetcolorpercentage(roi, ell);
+	}, [yaed, &frame](){
+		yaed->PrepareTargetColor(frame);
+	});
+}
+
 /*将得到的圆放入vector中，并对其中数量大于一定范围的圆进行下一步处理，以滤除偶然检测出的圆*/
 void filtellipse(Autopilot_Interface& api, vector<Ellipse>& ellipseok, vector<Ellipse>& ellipse_big){
 
@@ -1987,25 +2102,38 @@ void filtellipse(Autopilot_Interface& api, vector<Ellipse>& ellipseok, vector<El
 */
 }
 
-void nearellipse(Autopilot_Interface& api, vector<target>& target_ellipse){
-    float locx = api.current_messages.local_position_ned.x;
-    float locy = api.current_messages.local_position_ned.y;
-    int size = target_ellipse.size();
-	if(size == 0 || size == 1){
-
-	} else {
-		for (auto i = 0; i < size - 1; i++) {
-			for (auto j = 0; j < size - i - 1; j++){
-				float jdis = ellipsedistance(locx, locy, target_ellipse[j].locx, target_ellipse[j].locy);
-				float jplusdis = ellipsedistance(locx, locy, target_ellipse[j + 1].locx, target_ellipse[j + 1].locy);
-				if(jdis > jplusdis){
-					swap(target_ellipse[j], target_ellipse[j+1]);
-				}
-			}
-		}
-	}
-
+// 部分选择：只把最近的k个放到前面再排序，O(n + k log k)，不改动目标列表本身
+void nearest_targets(const vector<target>& targets, float x, float y, size_t k, vector<int>& ids, const vector<bool>* skip){
+    ids.clear();
+    for (size_t i = 0; i < targets.size(); i++) {
+        if (skip == NULL || i >= skip->size() || !(*skip)[i])
+            ids.push_back(int(i));
+    }
+    auto closer = [&](int l, int r) {
+        float dl = ellipsedistance(x, y, targets[l].locx, targets[l].locy);
+        float dr = ellipsedistance(x, y, targets[r].locx, targets[r].locy);
+        return dl < dr || (dl == dr && l < r);
+    };
+    if (k < ids.size()) {
+        nth_element(ids.begin(), ids.begin() + k, ids.end(), closer);
+        ids.resize(k);
+    }
+    sort(ids.begin(), ids.end(), closer);
+}
 
+int next_target(Autopilot_Interface& api, const vector<target>& targets, vector<bool>& visited){
+    std::lock_guard<std::mutex> lock(target_mutex);
+    vector<int> ids;
+    //暂定和已删除的目标不去
+    vector<bool> skip(targets.size());
+    visited.resize(targets.size(), false);
+    for (size_t i = 0; i < targets.size(); i++)
+        skip[i] = visited[i] || targets[i].state != TRACK_CONFIRMED;
+    nearest_targets(targets, api.current_messages.local_position_ned.x, api.current_messages.local_position_ned.y, 1, ids, &skip);
+    if (ids.empty())
+        return -1;
+    visited[ids[0]] = true;
+    return ids[0];
 }
 
 float ellipsedistance(float locx, float locy, float e_x, float e_y){
@@ -62,13 +62,43 @@
 #include <sys/time.h>
 #include <iostream>
 #include <fstream>
+#include <atomic>
+#include <mutex>
 #include "mavlink/common/mavlink.h"
+#include "latency_histogram.h"
 #include "ellipse/EllipseDetectorYaed.h"
+#include "ellipse/CandidateFilterChain.h"
+#include "target_grid.h"
+#include "target_tracker.h"
 
 extern bool stable, updateellipse, getlocalposition, drop;
-extern int TargetNum;
+extern int TargetNum;                       // 任务流程当前处理的目标编号(target::num)，-1为没有
 extern coordinate droptarget;
 extern vector<target> target_ellipse_position, ellipse_T, ellipse_F;
+extern Target_Grid target_grid;             // target_ellipse_position的网格索引，只在识别融合阶段使用
+extern Target_Tracker target_tracker;       // 目标的卡尔曼滤波和T/F后验，只在识别融合阶段更新
+/*识别融合阶段修改target_ellipse_position、ellipse_T、ellipse_F时持有target_mutex(push_back可能重新分配)，
+  任务流程等其他线程只通过get_target等函数在锁内读取拷贝*/
+extern std::mutex target_mutex;
+bool get_target(int num, target& t);
+/*目标num的判定结果：1为T，0为F，-1为尚未判定或不存在*/
+int target_decision(int num);
+/*已判定为T的目标数(ellipse_T的长度)*/
+size_t count_T();
+
+/*视觉流水线更新目标列表后发布所用帧的编号和采集时刻(单调时钟)，设定点据此计算延迟*/
+void publish_vision_frame(uint64_t frame_id, uint64_t capture_us);
+bool latest_vision_frame(uint64_t& frame_id, uint64_t& capture_us);
+
+/*resultTF第一次判定各目标的结果和时刻，回放时为日志时间(clock)，否则为系统时钟 us*/
+struct TF_Decision
+{
+	int num;
+	bool T;
+	uint64_t time_us;
+};
+void set_decision_clock(Replay_Clock *clock);
+vector<TF_Decision> tf_decisions();
 
 // ------------------------------------------------------------------------------
 //   Defines
@@ -131,6 +161,8 @@ extern vector<target> target_ellipse_position, ellipse_T, ellipse_F;
 
 // helper functions
 uint64_t get_time_usec();
+uint64_t get_monotonic_usec();
+long get_rss_kb();
 void set_position(float x, float y, float z, mavlink_set_position_target_local_ned_t &sp);
 void set_velocity(float vx, float vy, float vz, mavlink_set_position_target_local_ned_t &sp);
 //void set_acceleration(float ax, float ay, float az, mavlink_set_position_target_local_ned_t &sp);
@@ -311,6 +343,11 @@ public:
 
     bool getposition = 0;
 
+    // 最近一次视觉驱动的local设定点(对准、投放)依据的帧，及该帧从采集到设定点发出的延迟
+    std::atomic<uint64_t> setpoint_frame_id{0};
+    std::atomic<uint64_t> setpoint_latency_us{0};
+    Latency_Histogram setpoint_latency;
+
     int system_id;
     int autopilot_id;
     int companion_id;
@@ -324,6 +361,8 @@ public:
 
     //void update_setpoint(mavlink_set_position_target_local_ned_t setpoint);
     void update_local_setpoint(mavlink_set_position_target_local_ned_t setpoint);
+    // 视觉驱动的设定点，记录所用的帧和采集到发出的延迟
+    void update_local_setpoint(mavlink_set_position_target_local_ned_t setpoint, uint64_t frame_id, uint64_t capture_us);
 
     void update_global_setpoint(mavlink_set_position_target_global_int_t set_global_point);
 
@@ -388,14 +427,23 @@ private:
 
 };
 
-/*将当前时刻看到的所有可能为目标的椭圆存放在容器中*/
-void possible_ellipse(Autopilot_Interface& api, vector<coordinate>& ellipse_out, vector<target>& target_ellipse);
+/*将当前时刻看到的所有可能为目标的椭圆关联到目标并更新(target_tracker)，stamp_us为帧的采集时刻*/
+void possible_ellipse(Autopilot_Interface& api, vector<coordinate>& ellipse_out, vector<target>& target_ellipse, Target_Grid& grid, uint64_t stamp_us);
+/*识别前将椭圆关联到已有目标，设置coordinate::target*/
+void associate_targets(Autopilot_Interface& api, vector<coordinate>& ellipse_out, const vector<target>& target_ellipse, Target_Grid& grid, uint64_t stamp_us);
 void resultTF(Autopilot_Interface& api, vector<target>& ellipse_in, vector<target>& ellipse_1, vector<target>& ellipse_0);
 void getdroptarget(Autopilot_Interface& api, coordinate& droptarget, vector<coordinate>& ellipse_out);
 void realtarget(Autopilot_Interface& api, coordinate& cam, float& x, float& y);
+/*相机到目标平面的高度 m*/
+int32_t target_height(Autopilot_Interface& api);
 void OptimizEllipse(vector<Ellipse>& ellipse_out, vector<Ellipse>& ellipses_in);
+/*建立候选椭圆过滤链：图像边界、评分、偏心率、目标颜色，frame为过滤时使用的当前帧(640*360)*/
+void BuildCandidateFilters(CCandidateFilterChain& chain, CEllipseDetectorYaed* yaed, const CandidateFilterParams& params, Mat3b& frame);
 void filtellipse(Autopilot_Interface& api, vector<Ellipse>& ellipseok, vector<Ellipse>& ellipse_big);
-void nearellipse(Autopilot_Interface& api, vector<target>& target_ellipse);
+/*离(x, y)最近的k个目标的编号，按距离由近到远；skip[i]为true的目标不参与*/
+void nearest_targets(const vector<target>& targets, float x, float y, size_t k, vector<int>& ids, const vector<bool>* skip = NULL);
+/*任务流程取下一个目标：离飞机最近、已确认且未访问过的目标编号，并标记为已访问；没有时返回-1(持有target_mutex)*/
+int next_target(Autopilot_Interface& api, const vector<target>& targets, vector<bool>& visited);
 float ellipsedistance(float locx, float locy, float e_x, float e_y);
 #endif // AUTOPILOT_INTERFACE_H_
 
@@ -0,0 +1,176 @@
+#include "CandidateFilterChain.h"
+
+CandidateFilterParams::CandidateFilterParams()
+{
+	fMinScore = 0.6f;
+	fMaxEccentricity = 0.3f;
+	hsvBlue = HSVRange(0, 127, 0, 255, 106, 250);
+	hsvRed = HSVRange(131, 176, 0, 255, 106, 250);
+	rectWindows.push_back(ColorWindow(61, 95, 4, 28));
+	rectWindows.push_back(ColorWindow(5, 46, 58, 96));
+}
+
+static void ReadHSVRange(const FileNode& node, HSVRange& range)
+{
+	// [ lowH, highH, lowS, highS, lowV, highV ]
+	if (node.empty() || node.size() != 6) return;
+	range = HSVRange((int)node[0], (int)node[1], (int)node[2], (int)node[3], (int)node[4], (int)node[5]);
+}
+
+static void ReadWindows(const FileNode& node, vector<ColorWindow>& windows)
+{
+	// [ minBlue, maxBlue, minRed, maxRed, minBlue, ... ]
+	if (node.empty() || node.size() % 4 != 0) return;
+	windows.clear();
+	for (size_t i = 0; i < node.size(); i += 4)
+	{
+		windows.push_back(ColorWindow((float)node[int(i)], (float)node[int(i + 1)],
+									  (float)node[int(i + 2)], (float)node[int(i + 3)]));
+	}
+}
+
+void CandidateFilterParams::Read(const FileNode& node)
+{
+	if (node.empty()) return;
+
+	if (!node["score"].empty()) fMinScore = (float)node["score"];
+	if (!node["eccentricity"].empty()) fMaxEccentricity = (float)node["eccentricity"];
+	ReadHSVRange(node["hsv_blue"], hsvBlue);
+	ReadHSVRange(node["hsv_red"], hsvRed);
+	ReadWindows(node["rect_windows"], rectWindows);
+}
+
+
+CCandidateFilterChain::CCandidateFilterChain() : _uFrames(0)
+{
+}
+
+void CCandidateFilterChain::AddStage(const string& name, float fCost, std::function<bool(const Ellipse&)> accept,
+									 std::function<void()> prepare)
+{
+	FilterStage stage;
+	stage.name = name;
+	stage.fCost = fCost;
+	stage.accept = accept;
+	stage.prepare = prepare;
+	_stages.push_back(stage);
+	SortStages();
+}
+
+void CCandidateFilterChain::SortStages()
+{
+	stable_sort(_stages.begin(), _stages.end(),
+				[](const FilterStage& lhs, const FilterStage& rhs) { return lhs.fCost < rhs.fCost; });
+}
+
+bool CCandidateFilterChain::LoadPhases(const FileNode& node)
+{
+	if (node.empty() || !node.isMap()) return false;
+
+	_phases.clear();
+	for (FileNodeIterator it = node.begin(); it != node.end(); ++it)
+	{
+		FileNode phase = *it;
+		vector<FilterStageSetting>& settings = _phases[phase.name()];
+		for (FileNodeIterator jt = phase.begin(); jt != phase.end(); ++jt)
+		{
+			FilterStageSetting setting;
+			setting.name = (string)(*jt)["name"];
+			setting.fCost = (*jt)["cost"].empty() ? -1.f : (float)(*jt)["cost"];
+			setting.bEnabled = (*jt)["enabled"].empty() ? true : ((int)(*jt)["enabled"] != 0);
+			settings.push_back(setting);
+		}
+	}
+	_phase.clear();
+	return !_phases.empty();
+}
+
+void CCandidateFilterChain::SetPhase(const string& phase)
+{
+	if (phase == _phase) return;
+	_phase = phase;
+
+	map<string, vector<FilterStageSetting> >::const_iterator it = _phases.find(phase);
+	if (it == _phases.end())
+	{
+		// phase not configured: every stage with its declared cost
+		for (auto &stage : _stages) stage.bEnabled = true;
+		return;
+	}
+
+	// only the stages listed in the phase run
+	for (auto &stage : _stages)
+	{
+		stage.bEnabled = false;
+		for (auto &setting : it->second)
+		{
+			if (setting.name != stage.name) continue;
+			stage.bEnabled = setting.bEnabled;
+			if (setting.fCost >= 0.f) stage.fCost = setting.fCost;
+			break;
+		}
+	}
+	SortStages();
+}
+
+void CCandidateFilterChain::Run(const vector<Ellipse>& ellipses_in, vector<Ellipse>& ellipses_out)
+{
+	++_uFrames;
+	for (auto &stage : _stages) stage.bPrepared = false;
+
+	for (auto &e : ellipses_in)
+	{
+		bool bAccepted = true;
+		for (auto &stage : _stages)
+		{
+			if (!stage.bEnabled) continue;
+
+			double t0 = (double)getTickCount();
+			if (!stage.bPrepared)
+			{
+				if (stage.prepare) stage.prepare();
+				stage.bPrepared = true;
+			}
+			bool bOk = stage.accept(e);
+			stage.dTimeMs += ((double)getTickCount() - t0) * 1000. / getTickFrequency();
+
+			++stage.uEvaluated;
+			if (!bOk)
+			{
+				bAccepted = false;
+				break;
+			}
+			++stage.uAccepted;
+		}
+		if (bAccepted)
+		{
+			ellipses_out.push_back(e);
+		}
+	}
+}
+
+void CCandidateFilterChain::ResetStats()
+{
+	_uFrames = 0;
+	for (auto &stage : _stages)
+	{
+		stage.uEvaluated = 0;
+		stage.uAccepted = 0;
+		stage.dTimeMs = 0.0;
+	}
+}
+
+void CCandidateFilterChain::PrintStats(ostream& os) const
+{
+	os << "filter chain [" << _phase << "] frames = " << _uFrames << endl;
+	for (auto &stage : _stages)
+	{
+		double rate = stage.uEvaluated ? double(stage.uAccepted) / stage.uEvaluated : 0.0;
+		double ms = _uFrames ? stage.dTimeMs / _uFrames : 0.0;
+		os << "  " << stage.name << (stage.bEnabled ? "" : " (off)")
+		   << " cost = " << stage.fCost
+		   << " in = " << stage.uEvaluated
+		   << " pass = " << rate * 100 << "%"
+		   << " ms/frame = " << ms << endl;
+	}
+}
@@ -0,0 +1,98 @@
+/*
+Candidate filter chain for the ellipses found by the detector.
+
+Every stage accepts or rejects a single candidate and declares a relative cost.
+Stages run cheapest first and the chain stops at the first rejection, so the
+expensive stages (color) only see the candidates that survived the cheap ones.
+Acceptance rates and timings are kept for each stage.
+
+Thresholds and the per mission phase stage lists are read from a YAML/XML file
+(cv::FileStorage), see vision.yml.
+*/
+
+#pragma once
+
+#include <cv.h>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "common.h"
+#include "EllipseDetectorYaed.h"
+
+using namespace std;
+using namespace cv;
+
+struct FilterStage
+{
+	string	name;
+	float	fCost;						// declared relative cost, stages are sorted on it
+	bool	bEnabled;
+	std::function<bool(const Ellipse&)> accept;
+	std::function<void()> prepare;		// per frame work, done before the first candidate reaches the stage
+
+	// statistics
+	uint64_t	uEvaluated;
+	uint64_t	uAccepted;
+	double		dTimeMs;				// accept + prepare
+
+	bool	bPrepared;
+
+	FilterStage() : fCost(1.f), bEnabled(true), uEvaluated(0), uAccepted(0), dTimeMs(0.0), bPrepared(false) {}
+};
+
+// Stage settings of one mission phase
+struct FilterStageSetting
+{
+	string	name;
+	float	fCost;
+	bool	bEnabled;
+};
+
+// Thresholds of the candidate filters (defaults are the field values)
+struct CandidateFilterParams
+{
+	float	fMinScore;				// detector score
+	float	fMaxEccentricity;		// (a - b) / a
+	HSVRange hsvBlue;
+	HSVRange hsvRed;
+	vector<ColorWindow> rectWindows;
+
+	CandidateFilterParams();
+
+	// Read the "filter" node, missing keys keep their value
+	void Read(const FileNode& node);
+};
+
+class CCandidateFilterChain
+{
+	vector<FilterStage> _stages;						// sorted by cost
+	map<string, vector<FilterStageSetting> > _phases;	// stage settings per mission phase
+	string	_phase;
+	uint64_t _uFrames;
+
+	void SortStages();
+
+public:
+
+	CCandidateFilterChain();
+
+	void AddStage(const string& name, float fCost, std::function<bool(const Ellipse&)> accept,
+				  std::function<void()> prepare = std::function<void()>());
+
+	// Read the stage settings of every phase from the "phases" node, false if it is empty
+	bool LoadPhases(const FileNode& node);
+
+	// Apply the settings of a mission phase (enabled stages and costs), no-op if already active
+	void SetPhase(const string& phase);
+	const string& GetPhase() const { return _phase; }
+
+	// Filter the candidates of one frame, ellipses_out keeps the input order
+	void Run(const vector<Ellipse>& ellipses_in, vector<Ellipse>& ellipses_out);
+
+	const vector<FilterStage>& GetStages() const { return _stages; }
+	void ResetStats();
+	void PrintStats(ostream& os) const;
+};
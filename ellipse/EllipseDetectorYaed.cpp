@@ -34,11 +34,27 @@ CEllipseDetectorYaed::CEllipseDetectorYaed(void) : _times(6, 0.0), _timesHelper(
 	_fMaxCenterDistance2 = _fMaxCenterDistance * _fMaxCenterDistance;
 	_iMinEdgeLength = 16;
 	_fMinOrientedRectSide = 3.0f;
+	_fObbExactBand = 0.3f;
+	_uRoiPixels = 0;
+	_iRoiThreshold = 0;
 	_fDistanceToEllipseContour = 0.1f;
 	_fMinScore = 0.4f;
 	_fMinReliability = 0.4f;
 	_uNs = 16;
 
+	//红色为0°，绿色为120°,蓝色为240°。它们的补色是：黄色为60°，青色为180°,品红为300°；
+	//蓝色: H 0~127.5, V 106~250 (张婉莹：H 100~125, S 15~240, V 20~255)
+	_hsvBlue = HSVRange(0, 127, 0, 255, 106, 250);
+	//红色: H 131.5~176, V 106~250
+	_hsvRed = HSVRange(131, 176, 0, 255, 106, 250);
+	//彩色: S 64~255
+	_hsvColor = HSVRange(0, 180, 64, 255, 0, 255);
+	BuildColorLUT();
+
+	//外接矩形内像素个数除以4ab: 蓝色为主(蓝61~95, 红4~28)或红色为主(蓝5~46, 红58~96)
+	_rectWindows.push_back(ColorWindow(61, 95, 4, 28));
+	_rectWindows.push_back(ColorWindow(5, 46, 58, 96));
+
 	srand(unsigned(time(NULL)));
 }
 
@@ -432,9 +448,10 @@ void CEllipseDetectorYaed::DetectEdges13(Mat1b& DP, VVP& points_1, VVP& points_3
 {
 	// Vector of connected edge points
 	VVP contours;
+	vector<SegmentShape> shapes;
 
 	// Labeling 8-connected edge points, discarding edge too small
-	Labeling(DP, contours, _iMinEdgeLength);
+	Labeling(DP, contours, _iMinEdgeLength, &shapes);
 	int iContoursSize = int(contours.size());
 
 	// For each edge
@@ -446,10 +463,7 @@ void CEllipseDetectorYaed::DetectEdges13(Mat1b& DP, VVP& points_1, VVP& points_3
 
 		// Selection strategy - Step 1 - See Sect [3.1.2] of the paper
 		// Constraint on axes aspect ratio
-		RotatedRect oriented = minAreaRect(edgeSegment);
-		float o_min = min(oriented.size.width, oriented.size.height);
-
-		if (o_min < _fMinOrientedRectSide)
+		if (!CheckOrientedBox(edgeSegment, shapes[i], false))
 		{
 			continue;
 		}
@@ -494,9 +508,10 @@ void CEllipseDetectorYaed::DetectEdges24(Mat1b& DN, VVP& points_2, VVP& points_4
 {
 	// Vector of connected edge points
 	VVP contours;
+	vector<SegmentShape> shapes;
 
 	/// Labeling 8-connected edge points, discarding edge too small
-	Labeling(DN, contours, _iMinEdgeLength);
+	Labeling(DN, contours, _iMinEdgeLength, &shapes);
 
 	int iContoursSize = unsigned(contours.size());
 
@@ -510,10 +525,7 @@ void CEllipseDetectorYaed::DetectEdges24(Mat1b& DN, VVP& points_2, VVP& points_4
 
 		// Selection strategy - Step 1 - See Sect [3.1.2] of the paper
 		// Constraint on axes aspect ratio
-		RotatedRect oriented = minAreaRect(edgeSegment);
-		float o_min = min(oriented.size.width, oriented.size.height);
-
-		if (o_min < _fMinOrientedRectSide)
+		if (!CheckOrientedBox(edgeSegment, shapes[i], false))
 		{
 			continue;
 		}
@@ -1561,9 +1573,10 @@ void CEllipseDetectorYaed::Triplets413(VVP& pi,
 void CEllipseDetectorYaed::RemoveShortEdges(Mat1b& edges, Mat1b& clean)
 {
 	VVP contours;
+	vector<SegmentShape> shapes;
 
 	// Labeling and contraints on length
-	Labeling(edges, contours, _iMinEdgeLength);
+	Labeling(edges, contours, _iMinEdgeLength, &shapes);
 
 	int iContoursSize = contours.size();
 	for (int i = 0; i < iContoursSize; ++i)
@@ -1572,11 +1585,7 @@ void CEllipseDetectorYaed::RemoveShortEdges(Mat1b& edges, Mat1b& clean)
 		unsigned szEdge = edge.size();
 
 		// Constraint on axes aspect ratio
-		RotatedRect oriented = minAreaRect(edge);
-		if (oriented.size.width < _fMinOrientedRectSide ||
-			oriented.size.height < _fMinOrientedRectSide ||
-			oriented.size.width > oriented.size.height * _fMaxRectAxesRatio ||
-			oriented.size.height > oriented.size.width * _fMaxRectAxesRatio)
+		if (!CheckOrientedBox(edge, shapes[i], true))
 		{
 			continue;
 		}
@@ -1590,6 +1599,71 @@ void CEllipseDetectorYaed::RemoveShortEdges(Mat1b& edges, Mat1b& clean)
 
 
 
+// Constraints on the oriented bounding box of an arc (min side, and optionally aspect ratio).
+// The sides are estimated from the moments accumulated while labeling, minAreaRect
+// (convex hull + rotating calipers) is computed only when an estimate falls within
+// _fObbExactBand of a threshold.
+bool CEllipseDetectorYaed::CheckOrientedBox(VP& edge, const SegmentShape& shape, bool bCheckRatio)
+{
+#ifndef EXACT_CONSTRAINT_OBOX
+	float fVarMajor, fVarMinor;
+	shape.Axes(fVarMajor, fVarMinor);
+
+	float fMinor = sqrt(12.f * fVarMinor);
+	float fMajor = sqrt(12.f * fVarMajor);
+	float fMinorLowerBound = 2.f * sqrt(fVarMinor);
+
+	bool bExact = false;
+
+	// Min side
+	if (fMinorLowerBound < _fMinOrientedRectSide)
+	{
+		if (fMinor < _fMinOrientedRectSide * (1.f - _fObbExactBand))
+		{
+			return false;
+		}
+		if (fMinor < _fMinOrientedRectSide * (1.f + _fObbExactBand))
+		{
+			bExact = true;
+		}
+	}
+
+	// Aspect ratio
+	if (bCheckRatio && !bExact)
+	{
+		float fRatio = fMajor / max(fMinor, 1e-3f);
+		if (fRatio > _fMaxRectAxesRatio * (1.f + _fObbExactBand))
+		{
+			return false;
+		}
+		if (fRatio > _fMaxRectAxesRatio * (1.f - _fObbExactBand))
+		{
+			bExact = true;
+		}
+	}
+
+	if (!bExact)
+	{
+		return true;
+	}
+#endif
+
+	RotatedRect oriented = minAreaRect(edge);
+	if (oriented.size.width < _fMinOrientedRectSide ||
+		oriented.size.height < _fMinOrientedRectSide)
+	{
+		return false;
+	}
+	if (bCheckRatio &&
+		(oriented.size.width > oriented.size.height * _fMaxRectAxesRatio ||
+		 oriented.size.height > oriented.size.width * _fMaxRectAxesRatio))
+	{
+		return false;
+	}
+	return true;
+}
+
+
 void CEllipseDetectorYaed::PrePeocessing(Mat1b& I,
 	Mat1b& DP,
 	Mat1b& DN
@@ -1606,7 +1680,7 @@ void CEllipseDetectorYaed::PrePeocessing(Mat1b& I,
 	Mat1s DX, DY;			//sobel derivatives
 
 	// Detect edges
-	Canny3(I, E, DX, DY, 3, false);
+	Canny3(I, E, DX, DY, 3, false, &_cannyTh);
 
 	Toc(0); //edge detection
 
@@ -1899,15 +1973,17 @@ void CEllipseDetectorYaed::ClusterEllipses(vector<Ellipse>& ellipses)
 //Draw at most iTopN detected ellipses.
 void CEllipseDetectorYaed::DrawDetectedEllipses(Mat3b& output, vector<coordinate>& ellipse_out, vector<Ellipse>& ellipses, int iTopN, int thickness) {
 
-	//绘制椭圆
+	//绘制椭圆，output为空时只输出坐标
 	for(auto i = 0; i < ellipses.size(); i = i +1) {
 		Scalar color(0, 255, 0);
 		Ellipse& e = ellipses[i];
-		ellipse(output, Point(cvRound(e._xc), cvRound(e._yc)), Size(cvRound(e._a), cvRound(e._b)),
-				e._rad * 180.0 / CV_PI, 0.0, 360.0, color, thickness);
 		int j = i;
-		const string text = to_string(j);
-		putText(output, text, Point(cvRound(e._xc), cvRound(e._yc)),CV_FONT_HERSHEY_SIMPLEX,1,Scalar(0,0,255),2,8);//给目标编号
+		if(!output.empty()) {
+			ellipse(output, Point(cvRound(e._xc), cvRound(e._yc)), Size(cvRound(e._a), cvRound(e._b)),
+					e._rad * 180.0 / CV_PI, 0.0, 360.0, color, thickness);
+			const string text = to_string(j);
+			putText(output, text, Point(cvRound(e._xc), cvRound(e._yc)),CV_FONT_HERSHEY_SIMPLEX,1,Scalar(0,0,255),2,8);//给目标编号
+		}
 
         coordinate e_c;
 		e_c.x = e._xc;
@@ -1921,38 +1997,54 @@ void CEllipseDetectorYaed::DrawDetectedEllipses(Mat3b& output, vector<coordinate
 
 }
 
-void CEllipseDetectorYaed::extracrROI(Mat1b& image, vector<coordinate>& ellipse_out, vector<Mat1b>& img_roi){
+void CEllipseDetectorYaed::extracrROI(const Mat3b& frame, vector<coordinate>& ellipse_out, vector<Mat1b>& img_roi, bool bThreshold, float fScale){
 
-//	cvtColor(image, image, COLOR_RGB2GRAY);
-	GaussianBlur(image, image, Size(5, 5),0, 0);
+	//5x5高斯核的半径，窗口外扩这么多像素后，ROI内的滤波结果与整帧滤波相同
+	const int pad = 2;
+	//单阈值时170、190隔帧交替
 	static int number;
-	if(number == 0) {
-		threshold(image, image, 170, 255, CV_THRESH_BINARY);
-		number = 1;
-
-	} else{
-		threshold(image, image, 190, 255, CV_THRESH_BINARY);
-		number = 0;
-	}
-	for(auto &p:ellipse_out){
-		Mat1b ROI;
-		int r = 3 * p.a;
-		int x_l = 3 * p.x - r;
-		int y_l = 3 * p.y - r;
+	int th = (number == 0) ? 170 : 190;
+	if(bThreshold)
+		number = 1 - number;
+	_iRoiThreshold = bThreshold ? th : 0;
+
+	_uRoiPixels = 0;
+	size_t n = 0;
+	for(size_t i = 0; i < ellipse_out.size(); i++){
+		const coordinate& p = ellipse_out[i];
+		int r = fScale * p.a;
+		int x_l = fScale * p.x - r;
+		int y_l = fScale * p.y - r;
 		int width = 2 * r;
-		if((x_l>=0)&&(y_l>=0)&&((x_l+width)<=image.cols)&&((y_l+width)<=image.rows)){
-			ROI = image(Rect(x_l, y_l, width, width));
-			imshow("ROI", ROI);
-			img_roi.push_back(ROI);
-		} else
+		if(!((x_l>=0)&&(y_l>=0)&&((x_l+width)<=frame.cols)&&((y_l+width)<=frame.rows)))
 			continue;
 
+		//外扩后的窗口，在图像边界处截断(边界处与整帧滤波同样按反射处理)
+		Rect roi(x_l, y_l, width, width);
+		Rect win(x_l - pad, y_l - pad, width + 2 * pad, width + 2 * pad);
+		win &= Rect(0, 0, frame.cols, frame.rows);
+
+		if(_roiBuffers.size() <= n)
+			_roiBuffers.resize(n + 1);
+		Mat1b& buf = _roiBuffers[n];
+		cvtColor(frame(win), buf, COLOR_BGR2GRAY);
+		GaussianBlur(buf, buf, Size(5, 5), 0, 0);
+		if(bThreshold)
+			threshold(buf, buf, th, 255, CV_THRESH_BINARY);
+		_uRoiPixels += win.area();
+
+		Mat1b ROI = buf(roi - win.tl());
+		img_roi.push_back(ROI);
+		ellipse_out[n++] = p;
 	}
+	ellipse_out.resize(n);
 }
 void CEllipseDetectorYaed::big_vector(Mat3b& resultImage2, vector< Ellipse >& ellipse_in, vector< Ellipse >& ellipse_big)
 {
-    CEllipseDetectorYaed* gv;
-    Mat3b ROI;
+    if(ellipse_in.size() == 0)
+        return;
+
+    PrepareTargetColor(resultImage2);
 
     for(int i = 0; i < ellipse_in.size(); i++)
     {
@@ -1963,9 +2055,8 @@ void CEllipseDetectorYaed::big_vector(Mat3b& resultImage2, vector< Ellipse >& el
 
         if((x_l>=0)&&(y_l>=0)&&((x_l+width_roi)<=resultImage2.cols)&&((y_l+height_roi)<=resultImage2.rows))
         {
-            ROI=resultImage2(Rect(x_l, y_l, width_roi, height_roi));
             bool use;
-            use = gv->computcolorpercentage(ROI, ellipse_in[i]);
+            use = computcolorpercentage(ellipse_in[i]);
             if(use){
             	ellipse_big.push_back(ellipse_in[i]);
             } else
@@ -1979,91 +2070,29 @@ void CEllipseDetectorYaed::big_vector(Mat3b& resultImage2, vector< Ellipse >& el
     }
 }
 
-bool CEllipseDetectorYaed::computcolorpercentage(Mat3b& roi, Ellipse& ell_in)
+bool CEllipseDetectorYaed::computcolorpercentage(Ellipse& ell_in)
 {
-    //############################蓝色百分比##################################
-
-    Mat imageth_r;
-    /*
-    //红色为0°，绿色为120°,蓝色为240°。它们的补色是：黄色为60°，青色为180°,品红为300°；
-    //给出希望保留的hsv的取值范围
-    int iLowH_b = 0;//zwy:100;浅色圆：0；
-    int iHighH_b = 239;//张婉莹：125；浅色圆：239
-    int iLowS_b = 17;//张婉莹：15；浅色圆17
-    int iHighS_b = 145;//值越大，颜色越饱和张婉莹：240；浅色圆：145
-    int iLowV_b = 0;//值越小越黑张婉莹：20；浅色圆：0
-    int iHighV_b = 255;//张婉莹：255
-    */
-	//############################红色百分比##################################
-	//红色为0°，绿色为120°,蓝色为240°。它们的补色是：黄色为60°，青色为180°,品红为300°；
-	//给出希望保留的hsv的取值范围
-	int iLowH = 0;//0
-	int iHighH = 360;//224
-	int iLowS = 64;//29
-	int iHighS = 255;//值越大，颜色越饱和218
-	int iLowV = 0;//值越小越黑235
-	int iHighV = 255;//255
-
-
-    //计算像素总数,椭圆面积
-    int width_b,height_b, extro;
-    float ell_S_b,a_b,b_b;
-    width_b = roi.cols;
-    height_b = roi.rows;
-    a_b=ell_in._a;
-    b_b=ell_in._b;
-    ell_S_b=CV_PI * a_b * b_b;
-    extro = width_b * height_b - ell_S_b;
-
-    //对原始图像进行高斯滤波
-    GaussianBlur(roi, roi,Size(5,5),0,0);
-    cvtColor(roi, roi, COLOR_BGR2HSV);
-
-    //按阈值分割
-//    inRange(roi, Scalar(iLowH_b, iLowS_b, iLowV_b), Scalar(iHighH_b, iHighS_b, iHighV_b), imageth_b);//提取出的蓝色为白色部分
-	inRange(roi, Scalar(iLowH, iLowS, iLowV), Scalar(iHighH, iHighS, iHighV), imageth_r);//提取出的红色为黑色部分
+	//############################彩色百分比##################################
+	//彩色像素为S在64~255之间的像素(见_hsvColor)，其余为白色
+	//只统计椭圆内部的像素，分母为椭圆内像素个数。原来统计的是外接矩形内的像素而分母为椭圆面积πab，
+	//矩形四角的背景也计入，彩色比例可超过100%(上限125即由此而来)；现在两个比例之和为100%，
+	//彩色下限70的含义更严格，本函数(big_vector)目前没有调用
+	EllipseColorStats stats;
+	CountInEllipse(ell_in, 1.f, stats);
+	if(stats.iTotal == 0)
+		return false;
 
-	float add_w = 0,add_c = 0;
-	for(int i = 0;i < height_b; i++)
-	{
-		for(int j = 0;j < width_b; j++)
-		{
-			// 若像素值为255，add加一
-			if(imageth_r.at<uchar>(i,j) == 0)
-			{
-				add_w++;
-			} else{
-				add_c++;
-			}
-		}
-	}
+	float add_c = stats.iColor;
+	float add_w = stats.iTotal - stats.iColor;
 
     //-------------------计算百分比-------------------------
     //定义并计算百分比
     float percentage_color;
-    percentage_color = add_c / ell_S_b * 100;
+    percentage_color = add_c / stats.iTotal * 100;
 
-
-	  //############################蓝色百分比##################################
-
-    //-------------------计算百分比-------------------------
-    //定义并计算百分比，此时计算的是降噪后的结果
     float percentage_white;
-    percentage_white = add_w / ell_S_b * 100;
-/*
-	white.push_back(percentage_white);
-	color.push_back(percentage_color);
-	sort(white.begin(), white.end());
-	sort(color.begin(), color.end());
-	cout<<"white_l"<<white[0]<<endl;
-	cout<<"white_h"<<white[white.size() - 1]<<endl;
-	cout<<"color_l"<<color[0]<<endl;
-	cout<<"color_h"<<color[color.size() - 1]<<endl;
-	imshow("HSV提取", imageth_r);
-//	cout<<"大圆面积为"<<ell_S_b<<endl;
-//	cout<<"彩色占大圆比例为："<<percentage_color<<"%"<<endl;
-//	cout<<"白色占圆比例为："<< percentage_white <<"%"<<endl;
-*/
+    percentage_white = add_w / stats.iTotal * 100;
+
     if((percentage_color>=70)&&(percentage_white>= 0)&&(percentage_color<=125)&&(percentage_white<=40))
     {
 
@@ -2076,89 +2105,120 @@ bool CEllipseDetectorYaed::computcolorpercentage(Mat3b& roi, Ellipse& ell_in)
 
 }
 
-void visual_rec(vector<Mat1b>& gray, vector<coordinate>& ellipse_out0, vector<coordinate>& ellipse_out00, vector< vector<Point> >& contours0){
-	float areanum = 0.215;
-//    threshold(gray, gray, 120, 255, CV_THRESH_BINARY);
-//  imshow("threshold", thresh);
-//  morphologyEx(gauss, gauss, MORPH_CLOSE, (5, 5) );
-//    Canny(thresh, canny, 50, 150, 3);
-	vector< vector<Point> > contours;
-
-	for(auto j = 0; j < gray.size(); j++) {
-		findContours(gray[j], contours, CV_RETR_LIST, CV_CHAIN_APPROX_NONE);
-		for (int i = 0; i < contours.size(); i++) {
-			//拟合出轮廓外侧最小的矩形
-			RotatedRect rotate_rect = minAreaRect(contours[i]);
-			Point2f *vertices = new Point2f[4];
-			rotate_rect.points(vertices);
-			float h1_s, h2_s, h3_s, h4, h1_b, h2_b, h3_b;
-			/*****************************************************************
-			 * 大圆的参数
-			*****************************************************************/
-			h1_b = 0.6 * ellipse_out0[j].a;//只要h1,h2的系数在0.68571429这个值范围内就行1.8
-			h2_b = 0.9 * ellipse_out0[j].a;//h1:0.5,h2:0.86
-			h3_b = 0.16 * gray[j].cols;//0.55
-			h4 = 0.5 * gray[j].cols;
-			/*****************************************************************
-			 * 小圆的参数
-			*****************************************************************/
-			h1_s = 1.8 * ellipse_out0[j].a;//只要h1,h2的系数在0.68571429这个值范围内就行1.8
-			h2_s = 3 * ellipse_out0[j].a;//h1:0.5,h2:0.86
-			h3_s = 0.55 * gray[j].cols;//0.55
-
-//			rotate_rect.size.height < h1_s || rotate_rect.size.height > h2_s || rotate_rect.size.width < h1_s ||
-//			rotate_rect.size.width > h2_s || abs(rotate_rect.center.x - h4) > h3_s || abs(rotate_rect.center.y - h4) > h3_s
-			if ((rotate_rect.size.height > h1_s && rotate_rect.size.height < h2_s && rotate_rect.size.width > h1_s &&
-				 rotate_rect.size.width < h2_s && abs(rotate_rect.center.x - h4) < h3_s &&
-				 abs(rotate_rect.center.y - h4) < h3_s)
-				|| (rotate_rect.size.height > h1_b && rotate_rect.size.height < h2_b && rotate_rect.size.width > h1_b &&
-					rotate_rect.size.width < h2_b && abs(rotate_rect.center.x - h4) < h3_b &&
-					abs(rotate_rect.center.y - h4) < h3_b)
-					){
-			float x12 = (vertices[1].x + vertices[2].x) / 2;
-			float y12 = (vertices[1].y + vertices[2].y) / 2;
-			float xt12 = areanum * (rotate_rect.center.x - x12) + x12;
-			float yt12 = y12 - areanum * (y12 - rotate_rect.center.y);
-
-			float x30 = (vertices[3].x + vertices[0].x) / 2;
-			float y30 = (vertices[3].y + vertices[0].y) / 2;
-			float yt30 = areanum * (rotate_rect.center.y - y30) + y30;
-			float xt30 = x30 - areanum * (x30 - rotate_rect.center.x);
-
-			float x23 = (vertices[2].x + vertices[3].x) / 2;
-			float y23 = (vertices[2].y + vertices[3].y) / 2;
-			float xt23 = areanum * (rotate_rect.center.x - x23) + x23;
-			float yt23 = y23 - areanum * (y23 - rotate_rect.center.y);
-
-			float x01 = (vertices[1].x + vertices[0].x) / 2;
-			float y01 = (vertices[1].y + vertices[0].y) / 2;
-			float yt01 = areanum * (rotate_rect.center.y - y01) + y01;
-			float xt01 = x01 - areanum * (x01 - rotate_rect.center.x);
-
-			if (abs((gray[j].at<uchar>(yt12, xt12) - gray[j].at<uchar>(yt30, xt30))) < 60
-				&& abs((gray[j].at<uchar>(yt23, xt23) - gray[j].at<uchar>(yt01, xt01))) < 60) {
-				ellipse_out0[j].flag = 1;
-			} else {
-				ellipse_out0[j].flag = 0;
-			}
-			vector<Point> contour;
-			for (int i = 0; i < 4; i++) {
-				vertices[i].x = vertices[i].x + (3 * ellipse_out0[j].x - 3 * ellipse_out0[j].a);
-				vertices[i].y = vertices[i].y + (3 * ellipse_out0[j].y - 3 * ellipse_out0[j].a);
-				contour.push_back(vertices[i]);
-			}
-			contours0.push_back(contour);
-		}else
-		continue;
-		}
-		ellipse_out00.push_back(ellipse_out0[j]);
-	}
+void CEllipseDetectorYaed::SetTargetColorRanges(const HSVRange& blue, const HSVRange& red)
+{
+    _hsvBlue = blue;
+    _hsvRed = red;
+    BuildColorLUT();
+}
+
+void CEllipseDetectorYaed::BuildColorLUT()
+{
+    //H、S、V三个通道分别查表，三个结果按位与即为像素类别
+    for(int v = 0; v < 256; v++)
+    {
+        _lutH[v] = uchar(((v >= _hsvBlue.iLowH && v <= _hsvBlue.iHighH) ? 1 : 0) |
+                         ((v >= _hsvRed.iLowH && v <= _hsvRed.iHighH) ? 2 : 0) |
+                         ((v >= _hsvColor.iLowH && v <= _hsvColor.iHighH) ? 4 : 0));
+        _lutS[v] = uchar(((v >= _hsvBlue.iLowS && v <= _hsvBlue.iHighS) ? 1 : 0) |
+                         ((v >= _hsvRed.iLowS && v <= _hsvRed.iHighS) ? 2 : 0) |
+                         ((v >= _hsvColor.iLowS && v <= _hsvColor.iHighS) ? 4 : 0));
+        _lutV[v] = uchar(((v >= _hsvBlue.iLowV && v <= _hsvBlue.iHighV) ? 1 : 0) |
+                         ((v >= _hsvRed.iLowV && v <= _hsvRed.iHighV) ? 2 : 0) |
+                         ((v >= _hsvColor.iLowV && v <= _hsvColor.iHighV) ? 4 : 0));
+    }
+}
+
+void CEllipseDetectorYaed::PrepareTargetColor(const Mat3b& frame)
+{
+    //对原始图像进行高斯滤波，结果放在单独的缓存中，不修改输入图像
+    GaussianBlur(frame, _colorBlur, Size(5, 5), 0, 0);
+    cvtColor(_colorBlur, _colorHSV, COLOR_BGR2HSV);
+
+    int rows = _colorHSV.rows;
+    int cols = _colorHSV.cols;
+    _rowBlue.create(rows, cols + 1);
+    _rowRed.create(rows, cols + 1);
+    _rowColor.create(rows, cols + 1);
+    _integralBlue.create(rows + 1, cols + 1);
+    _integralRed.create(rows + 1, cols + 1);
+    memset(_integralBlue.ptr<int>(0), 0, (cols + 1) * sizeof(int));
+    memset(_integralRed.ptr<int>(0), 0, (cols + 1) * sizeof(int));
+
+    //一次遍历完成分类、行积分图和两张积分图
+    for(int i = 0; i < rows; i++)
+    {
+        const Vec3b* _hsv = _colorHSV.ptr<Vec3b>(i);
+        int* _rb = _rowBlue.ptr<int>(i);
+        int* _rr = _rowRed.ptr<int>(i);
+        int* _rc = _rowColor.ptr<int>(i);
+        const int* _pb = _integralBlue.ptr<int>(i);
+        const int* _pr = _integralRed.ptr<int>(i);
+        int* _b = _integralBlue.ptr<int>(i + 1);
+        int* _r = _integralRed.ptr<int>(i + 1);
+        _rb[0] = _rr[0] = _rc[0] = 0;
+        _b[0] = _r[0] = 0;
+        for(int j = 0; j < cols; j++)
+        {
+            uchar c = _lutH[_hsv[j][0]] & _lutS[_hsv[j][1]] & _lutV[_hsv[j][2]];
+            _rb[j + 1] = _rb[j] + (c & 1);
+            _rr[j + 1] = _rr[j] + ((c >> 1) & 1);
+            _rc[j + 1] = _rc[j] + (c >> 2);
+            _b[j + 1] = _pb[j + 1] + _rb[j + 1];
+            _r[j + 1] = _pr[j + 1] + _rr[j + 1];
+        }
+    }
+}
+
+void CEllipseDetectorYaed::CountInEllipse(const Ellipse& e, float fScale, EllipseColorStats& stats) const
+{
+    float a = e._a * fScale;
+    float b = e._b * fScale;
+    if(a <= 0.f || b <= 0.f || _rowBlue.empty())
+        return;
+
+    //旋转椭圆隐式方程 A*dx^2 + B*dx*dy + C*dy^2 = 1，逐行求解dx得到水平区间
+    float c = cos(e._rad);
+    float s = sin(e._rad);
+    float ia2 = 1.f / (a * a);
+    float ib2 = 1.f / (b * b);
+    float A = c * c * ia2 + s * s * ib2;
+    float B = 2.f * c * s * (ia2 - ib2);
+    float C = s * s * ia2 + c * c * ib2;
+    float half_h = sqrt(a * a * s * s + b * b * c * c);
+
+    int rows = _rowBlue.rows;
+    int cols = _rowBlue.cols - 1;
+    int y0 = max(0, int(ceil(e._yc - half_h)));
+    int y1 = min(rows - 1, int(floor(e._yc + half_h)));
+    for(int y = y0; y <= y1; y++)
+    {
+        float dy = float(y) - e._yc;
+        float disc = B * B * dy * dy - 4.f * A * (C * dy * dy - 1.f);
+        if(disc < 0.f)
+            continue;
+        float sq = sqrt(disc);
+        int xl = max(0, int(ceil(e._xc + (-B * dy - sq) / (2.f * A))));
+        int xr = min(cols - 1, int(floor(e._xc + (-B * dy + sq) / (2.f * A))));
+        if(xr < xl)
+            continue;
+
+        const int* _rb = _rowBlue.ptr<int>(y);
+        const int* _rr = _rowRed.ptr<int>(y);
+        const int* _rc = _rowColor.ptr<int>(y);
+        stats.iTotal += xr - xl + 1;
+        stats.iBlue += _rb[xr + 1] - _rb[xl];
+        stats.iRed += _rr[xr + 1] - _rr[xl];
+        stats.iColor += _rc[xr + 1] - _rc[xl];
+    }
 }
 
 void CEllipseDetectorYaed::targetcolor(Mat3b& resultImage2, vector< Ellipse >& ellipse_in, vector< Ellipse >& ellipse_big)
 {
-    CEllipseDetectorYaed* gv;
-    Mat3b ROI;
+    if(ellipse_in.size() == 0)
+        return;
+
+    PrepareTargetColor(resultImage2);
 
     for(int i = 0; i < ellipse_in.size(); i++)
     {
@@ -2169,9 +2229,8 @@ void CEllipseDetectorYaed::targetcolor(Mat3b& resultImage2, vector< Ellipse >& e
 
         if((x_l>=0)&&(y_l>=0)&&((x_l+width_roi)<=resultImage2.cols)&&((y_l+height_roi)<=resultImage2.rows))
         {
-            ROI=resultImage2(Rect(x_l, y_l, width_roi, height_roi));
             bool use;
-            use = gv->computetargetcolorpercentage(ROI, ellipse_in[i]);
+            use = computetargetcolorpercentage(Rect(x_l, y_l, width_roi, height_roi), ellipse_in[i]);
             if(use){
                 ellipse_big.push_back(ellipse_in[i]);
             } else
@@ -2185,111 +2244,31 @@ void CEllipseDetectorYaed::targetcolor(Mat3b& resultImage2, vector< Ellipse >& e
     }
 }
 
-bool CEllipseDetectorYaed::computetargetcolorpercentage(Mat3b& roi, Ellipse& ell_in)
+bool CEllipseDetectorYaed::computetargetcolorpercentage(const Rect& roi, Ellipse& ell_in)
 {
-    //############################蓝色百分比##################################
-
-    Mat imageth_r, imageth_b;
-
-    //红色为0°，绿色为120°,蓝色为240°。它们的补色是：黄色为60°，青色为180°,品红为300°；
-    //给出希望保留的hsv的取值范围
-    int iLowH_b = 0;//zwy:100;浅色圆：0；
-    int iHighH_b = 127.5;//张婉莹：125；浅色圆：239
-    int iLowS_b = 0;//张婉莹：15；浅色圆17
-    int iHighS_b = 255;//值越大，颜色越饱和张婉莹：240；浅色圆：145
-    int iLowV_b = 106;//值越小越黑张婉莹：20；浅色圆：0
-    int iHighV_b = 250;//张婉莹：255
-
-    //############################红色百分比##################################
-    //红色为0°，绿色为120°,蓝色为240°。它们的补色是：黄色为60°，青色为180°,品红为300°；
-    //给出希望保留的hsv的取值范围
-    int iLowH_r = 131.5;//0
-    int iHighH_r = 176;//224
-    int iLowS_r = 0;//29
-    int iHighS_r = 255;//值越大，颜色越饱和218
-    int iLowV_r = 106;//值越小越黑235
-    int iHighV_r = 250;//255
-
-
     //计算像素总数,椭圆面积
-    int width_b,height_b;
     float rect_S,a_b,b_b;
-    width_b = roi.cols;
-    height_b = roi.rows;
     a_b=ell_in._a;
     b_b=ell_in._b;
     rect_S = 4 * a_b * b_b;
 
-    //对原始图像进行高斯滤波
-    GaussianBlur(roi, roi,Size(5,5),0,0);
-    cvtColor(roi, roi, COLOR_BGR2HSV);
-
-    //按阈值分割
-    inRange(roi, Scalar(iLowH_b, iLowS_b, iLowV_b), Scalar(iHighH_b, iHighS_b, iHighV_b), imageth_b);//提取出的蓝色为白色部分
-    inRange(roi, Scalar(iLowH_r, iLowS_r, iLowV_r), Scalar(iHighH_r, iHighS_r, iHighV_r), imageth_r);//提取出的红色为黑色部分
-
-    float add_r = 0,add_b = 0;
-    for(int i = 0;i < height_b; i++)
-    {
-        for(int j = 0;j < width_b; j++)
-        {
-            // 若像素值为255，add加一
-            if(imageth_r.at<uchar>(i,j) == 255)
-            {
-                add_r++;
-            } else{
-            }
-        }
-    }
-
-    for(int i = 0;i < height_b; i++)
-    {
-        for(int j = 0;j < width_b; j++)
-        {
-            // 若像素值为255，add加一
-            if(imageth_b.at<uchar>(i,j) == 255)
-            {
-                add_b++;
-            } else{
-            }
-        }
-    }
+    //由积分图直接得到ROI内蓝色、红色像素个数
+    float add_b = CountInRect(_integralBlue, roi);
+    float add_r = CountInRect(_integralRed, roi);
 
     //-------------------计算百分比-------------------------
     //定义并计算百分比
     float percentage_blue;
     percentage_blue = add_b / rect_S * 100;
 
-
-    //############################蓝色百分比##################################
-
-    //-------------------计算百分比-------------------------
-    //定义并计算百分比，此时计算的是降噪后的结果
     float percentage_red;
     percentage_red = add_r / rect_S * 100;
-/*
-	white.push_back(percentage_white);
-	color.push_back(percentage_color);
-	sort(white.begin(), white.end());
-	sort(color.begin(), color.end());
-	cout<<"white_l"<<white[0]<<endl;
-	cout<<"white_h"<<white[white.size() - 1]<<endl;
-	cout<<"color_l"<<color[0]<<endl;
-	cout<<"color_h"<<color[color.size() - 1]<<endl;
-	imshow("HSV提取", imageth_r);
-//	cout<<"大圆面积为"<<ell_S_b<<endl;
-//	cout<<"彩色占大圆比例为："<<percentage_color<<"%"<<endl;
-//	cout<<"白色占圆比例为："<< percentage_white <<"%"<<endl;
-*/
-    if(((percentage_blue>=61)&&(percentage_red>= 4)&&(percentage_blue<=95)&&(percentage_red<=28))
-       ||((percentage_blue>=5)&&(percentage_red>= 58)&&(percentage_blue<=46)&&(percentage_red<=96)))
-    {
 
-        return true;
-    }
-    else
+    for(auto &w:_rectWindows)
     {
-        return false;
+        if(w.Contains(percentage_blue, percentage_red))
+            return true;
     }
+    return false;
 
 }
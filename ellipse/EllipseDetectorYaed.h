@@ -48,6 +48,7 @@ using namespace cv;
 //#define DISCARD_CONSTRAINT_CONVEXITY
 //#define DISCARD_CONSTRAINT_POSITION
 //#define DISCARD_CONSTRAINT_CENTER
+//#define EXACT_CONSTRAINT_OBOX		// always use minAreaRect for the oriented box constraints
 //const float high = 0.75;//桌子单位
 //const float fx = 734.0686, fy = 737.9659;//c525
 //const float cx = 316.2778, cy = 232.4590;
@@ -76,8 +77,14 @@ struct coordinate {
     int order;
     float a;
     uchar flag;//0为F，1为T, 2为未识别
-
-    coordinate() : x(0), y(0), locx(0), locy(0), num(0), possible(0), order(0), a(0), flag(0) {}
+    uchar votesT;//多阈值识别时判为T、F的阈值个数，单阈值识别时为0
+    uchar votesF;
+    float conf;//本帧识别置信度 |votesT - votesF| / 阈值个数
+    float probT;//分类器给出的T的概率，未使用分类器时为-1
+    int16_t target;//识别前关联到的target_ellipse_position序号，-1为新目标
+    bool cached;//识别结果沿用识别缓存中上次的结果，不是新的识别
+
+    coordinate() : x(0), y(0), locx(0), locy(0), num(0), possible(0), order(0), a(0), flag(0), votesT(0), votesF(0), conf(0), probT(-1), target(-1), cached(false) {}
 	bool operator<(const coordinate& other) const{
 		float dis1 = locx * locx + locy * locy;
 		float dis2 = other.locx * other.locx + other.locy * other.locy;
@@ -87,20 +94,34 @@ struct coordinate {
 };
 extern vector<coordinate> ellipse_pre;
 
+//目标跟踪状态(见target_tracker.h)
+enum {
+	TRACK_TENTATIVE = 0,	//暂定：观测次数不足，超时未再观测到则删除
+	TRACK_CONFIRMED,		//确认
+	TRACK_DEAD				//已删除，编号不再使用
+};
+
 struct target{
     float_t x;
     float_t y;
     float a;
     uint32_t T_N;
     uint32_t F_N;
-    float possbile;
+    float possbile;//T的后验概率
 	int32_t lat; /*< Latitude, expressed as degrees * 1E7*/
 	int32_t lon;
-	int num;
-	float locx;
+	int num;//目标编号：在target_ellipse_position中的序号，目标只在末尾添加，创建后不变
+	float locx;//卡尔曼滤波估计的位置(本地坐标系 m)
 	float locy;
+	float logodds;//T/F的对数几率(贝叶斯累计)，>0倾向T
+	float var_xx, var_xy, var_yy;//位置估计的协方差 m²
+	uint64_t last_us;//最近一次关联到观测的时刻(单调时钟)
+	uint16_t hits;//关联到的观测次数
+	uint16_t recognitions;//其中新识别出T或F的次数(不含识别缓存沿用的结果)
+	int8_t state;//TRACK_TENTATIVE/TRACK_CONFIRMED/TRACK_DEAD
 
-	target() : x(0), y(0), a(0), T_N(0), F_N(0), possbile(0), lat(0), lon(0), num(0), locx(0), locy(0) {}
+	target() : x(0), y(0), a(0), T_N(0), F_N(0), possbile(0), lat(0), lon(0), num(0), locx(0), locy(0), logodds(0),
+	           var_xx(0), var_xy(0), var_yy(0), last_us(0), hits(0), recognitions(0), state(TRACK_TENTATIVE) {}
 
 	bool operator<(const target& other) const{
 		if(possbile == other.possbile){
@@ -110,6 +131,45 @@ struct target{
 	}
 };
 
+// HSV range (OpenCV 8 bit convention: H in [0,180], S and V in [0,255]), bounds included
+struct HSVRange
+{
+	int iLowH, iHighH;
+	int iLowS, iHighS;
+	int iLowV, iHighV;
+
+	HSVRange() : iLowH(0), iHighH(180), iLowS(0), iHighS(255), iLowV(0), iHighV(255) {}
+	HSVRange(int lowH, int highH, int lowS, int highS, int lowV, int highV) :
+		iLowH(lowH), iHighH(highH), iLowS(lowS), iHighS(highS), iLowV(lowV), iHighV(highV) {}
+};
+
+// Accepted window of blue / red percentages for a target candidate
+struct ColorWindow
+{
+	float fMinBlue, fMaxBlue;
+	float fMinRed, fMaxRed;
+
+	ColorWindow() : fMinBlue(0.f), fMaxBlue(100.f), fMinRed(0.f), fMaxRed(100.f) {}
+	ColorWindow(float minBlue, float maxBlue, float minRed, float maxRed) :
+		fMinBlue(minBlue), fMaxBlue(maxBlue), fMinRed(minRed), fMaxRed(maxRed) {}
+
+	bool Contains(float blue, float red) const
+	{
+		return blue >= fMinBlue && blue <= fMaxBlue && red >= fMinRed && red <= fMaxRed;
+	}
+};
+
+// Color counts of the pixels whose center lies inside an ellipse
+struct EllipseColorStats
+{
+	int iTotal;
+	int iBlue;
+	int iRed;
+	int iColor;		// saturated pixels, see computcolorpercentage
+
+	EllipseColorStats() : iTotal(0), iBlue(0), iRed(0), iColor(0) {}
+};
+
 // Data available after selection strategy.
 // They are kept in an associative array to:
 // 1) avoid recomputing data when starting from same arcs
@@ -144,6 +204,7 @@ class CEllipseDetectorYaed
 	int		_iMinEdgeLength;					// minimum edge size				
 	float	_fMinOrientedRectSide;				// minumum size of the oriented bounding box containing the arc
 	float	_fMaxRectAxesRatio;					// maximum aspect ratio of the oriented bounding box containing the arc
+	float	_fObbExactBand;						// relative band around the thresholds where minAreaRect is still computed
 
 	// Selection strategy - Step 2 - Remove according to mutual convexities. See Sect [] in the paper
 	float _fThPosition;
@@ -162,6 +223,32 @@ class CEllipseDetectorYaed
 	float	_fMinScore;							// minimum score to confirm a detection
 	float	_fMinReliability;					// minimum auxiliary score to confirm a detection
 
+	// Edge detection - adaptive Canny thresholds, optionally carried over between frames
+	CannyThresholds _cannyTh;
+
+
+	// Target color - the frame is converted and classified once, see PrepareTargetColor
+	HSVRange _hsvBlue;
+	HSVRange _hsvRed;
+	HSVRange _hsvColor;		// saturated pixels, used by big_vector
+	uchar	_lutH[256];		// per channel class lookup tables, bit 0 blue, bit 1 red, bit 2 saturated
+	uchar	_lutS[256];
+	uchar	_lutV[256];
+	Mat3b	_colorBlur;		// blurred copy of the frame, the input is never modified
+	Mat3b	_colorHSV;
+	Mat1i	_rowBlue;		// row integral images of the masks, rows x (cols+1)
+	Mat1i	_rowRed;
+	Mat1i	_rowColor;
+	Mat1i	_integralBlue;	// integral images of the blue and red masks, (rows+1) x (cols+1)
+	Mat1i	_integralRed;
+
+	// Target color - acceptance windows
+	vector<ColorWindow> _rectWindows;		// percentages of the bounding rectangle over 4ab
+
+	// T/F ROIs - only the padded windows around the targets are converted, blurred and thresholded
+	vector<Mat1b> _roiBuffers;		// one buffer per ROI, reused between frames
+	uint64_t _uRoiPixels;			// pixels processed by the last extracrROI call
+	int _iRoiThreshold;				// threshold used by the last extracrROI call, 0 if not thresholded
 
 	// auxiliary variables
 	Size	_szImg;			// input image size
@@ -198,12 +285,34 @@ public:
 
     void targetcolor(Mat3b& resultImage2, vector< Ellipse >& ellipse_in, vector< Ellipse >& ellipse_big);
 
-    bool computetargetcolorpercentage(Mat3b& roi, Ellipse& ell_in);
+    //整帧转换HSV并按颜色分类，生成蓝色、红色积分图，之后每个椭圆的颜色统计为O(1)
+    void PrepareTargetColor(const Mat3b& frame);
+
+    bool computetargetcolorpercentage(const Rect& roi, Ellipse& ell_in);
+
+    //Set the HSV ranges of the two target colors
+    void SetTargetColorRanges(const HSVRange& blue, const HSVRange& red);
+
+    //Set the accepted percentage windows of the bounding rectangle score
+    void SetTargetColorWindows(const vector<ColorWindow>& rectWindows) { _rectWindows = rectWindows; };
+
+    //扫描线统计椭圆内(半轴乘以fScale)各颜色像素个数，需先调用PrepareTargetColor
+    void CountInEllipse(const Ellipse& e, float fScale, EllipseColorStats& stats) const;
 
-	//提取ROI
-    void extracrROI(Mat1b& image, vector<coordinate>& ellipse_out, vector<Mat1b>& img_roi);
+	//提取ROI：输入原分辨率彩色帧，只对每个目标周围(外扩2像素)的窗口做灰度、滤波和二值化
+	//没有完整ROI的椭圆从ellipse_out中去掉，保证img_roi[j]与ellipse_out[j]对应
+    //bThreshold为false时输出滤波后的灰度ROI，由识别器自行选择阈值(多阈值识别)
+    //fScale为frame相对检测图(椭圆坐标)的放大倍数，1920*1080对640*360为3
+    //img_roi[j]是_roiBuffers上的Mat头，下一次调用时被覆盖；需要保留到之后的要clone()
+    void extracrROI(const Mat3b& frame, vector<coordinate>& ellipse_out, vector<Mat1b>& img_roi, bool bThreshold = true, float fScale = 3.f);
 
-	bool computcolorpercentage(Mat3b& roi, Ellipse& ell_in);
+    //上一帧extracrROI处理的像素数
+    uint64_t GetRoiPixels() const { return _uRoiPixels; };
+    //上一帧extracrROI使用的二值化阈值，未二值化时为0
+    int GetRoiThreshold() const { return _iRoiThreshold; };
+
+	//按椭圆内部像素的彩色、白色比例判断，需先调用PrepareTargetColor(big_vector中调用)
+	bool computcolorpercentage(Ellipse& ell_in);
 
 	void big_vector(Mat3b& resultImage2, vector< Ellipse >& ellipse_in, vector< Ellipse >& ellipse_big);
     //Set the parameters of the detector
@@ -219,6 +328,26 @@ public:
 							int     iNs
 						);
 
+	//Change the size dependent parameters (working resolution or expected target size);
+	//after a change of the image size the carried Canny thresholds are recomputed
+	void SetSizeParameters(int iMinEdgeLength, float fMaxCenterDistance, bool bNewImageSize)
+	{
+		_iMinEdgeLength = iMinEdgeLength;
+		_fMaxCenterDistance = fMaxCenterDistance;
+		_fMaxCenterDistance2 = fMaxCenterDistance * fMaxCenterDistance;
+		if (bNewImageSize)
+			_cannyTh.iAge = -1;
+	};
+
+	//Select how the Canny thresholds are updated along a video stream (see CannyThresholds)
+	void SetCannyThresholdMode(int iMode, float fAlpha = 0.2f, int iRefresh = 10)
+	{
+		_cannyTh.iMode = iMode;
+		_cannyTh.fAlpha = fAlpha;
+		_cannyTh.iRefresh = iRefresh;
+		_cannyTh.iAge = -1;
+	};
+
 	// Return the execution time
 	double GetExecTime() { return _times[0] + _times[1] + _times[2] + _times[3] + _times[4] + _times[5]; }
 	vector<double> GetTimes() { return _times; }
@@ -238,8 +367,18 @@ private:
 
 	void RemoveShortEdges(Mat1b& edges, Mat1b& clean);
 
+	bool CheckOrientedBox(VP& edge, const SegmentShape& shape, bool bCheckRatio);
+
 	void ClusterEllipses(vector<Ellipse>& ellipses);
 
+	void BuildColorLUT();
+
+	int inline CountInRect(const Mat1i& integral, const Rect& r) const
+	{
+		return integral(r.y + r.height, r.x + r.width) - integral(r.y, r.x + r.width)
+			 - integral(r.y + r.height, r.x) + integral(r.y, r.x);
+	};
+
 	int FindMaxK(const vector<int>& v) const;
 	int FindMaxN(const vector<int>& v) const;
 	int FindMaxA(const vector<int>& v) const;
@@ -0,0 +1,226 @@
+#include "TFClassifier.h"
+#include <highgui.h>
+#include <fstream>
+#include <iostream>
+#include <cstdio>
+#include <numeric>
+
+CTFClassifier::CTFClassifier() :
+	_hog(Size(TF_CLS_SIZE, TF_CLS_SIZE), Size(16, 16), Size(8, 8), Size(8, 8), 9),
+	_b(0.f), _plattA(1.f), _plattB(0.f)
+{
+}
+
+bool CTFClassifier::Load(const string& file)
+{
+	FileStorage fs(file, FileStorage::READ);
+	if (!fs.isOpened()) return false;
+
+	Mat w;
+	fs["w"] >> w;
+	if ((int)fs["size"] != TF_CLS_SIZE || w.rows != FeatureSize() || w.cols != 1)
+	{
+		cout << "TF model " << file << " does not match the feature layout" << endl;
+		return false;
+	}
+	w.convertTo(_w, CV_32F);
+	_b = (float)fs["b"];
+	_plattA = (float)fs["platt_a"];
+	_plattB = (float)fs["platt_b"];
+	return true;
+}
+
+bool CTFClassifier::Save(const string& file) const
+{
+	FileStorage fs(file, FileStorage::WRITE);
+	if (!fs.isOpened()) return false;
+
+	fs << "size" << TF_CLS_SIZE;
+	fs << "w" << Mat(_w);
+	fs << "b" << _b;
+	fs << "platt_a" << _plattA;
+	fs << "platt_b" << _plattB;
+	return true;
+}
+
+void CTFClassifier::ExtractBatch(const vector<Mat1b>& rois, Mat1f& features)
+{
+	int n = int(rois.size());
+	int D = FeatureSize();
+	features.create(n, D);
+
+	for (int i = 0; i < n; ++i)
+	{
+		if (Degenerate(rois[i]))
+		{
+			features.row(i).setTo(0.f);
+			continue;
+		}
+		resize(rois[i], _norm, Size(TF_CLS_SIZE, TF_CLS_SIZE), 0, 0, INTER_AREA);
+		_hog.compute(_norm, _desc);
+		memcpy(features[i], &_desc[0], D * sizeof(float));
+	}
+}
+
+static inline float Sigmoid(float s)
+{
+	return 1.f / (1.f + exp(-s));
+}
+
+void CTFClassifier::PredictBatch(const vector<Mat1b>& rois, vector<float>& probT)
+{
+	int n = int(rois.size());
+	probT.resize(n);
+	if (n == 0) return;
+	if (Empty())
+	{
+		for (int i = 0; i < n; ++i)
+		{
+			probT[i] = Degenerate(rois[i]) ? -1.f : 0.5f;
+		}
+		return;
+	}
+
+	ExtractBatch(rois, _features);
+	gemm(_features, _w, 1.0, Mat(), 0.0, _scores);
+
+	for (int i = 0; i < n; ++i)
+	{
+		probT[i] = Degenerate(rois[i]) ? -1.f : Sigmoid(_plattA * (_scores(i, 0) + _b) + _plattB);
+	}
+}
+
+float CTFClassifier::Train(const vector<Mat1b>& rois, const vector<int>& labels, int iIterations,
+						   float fLearningRate, float fLambda, float fHoldOut)
+{
+	int n = int(min(rois.size(), labels.size()));
+	if (n == 0) return 0.f;
+
+	Mat1f F;
+	ExtractBatch(rois, F);
+	int D = F.cols;
+
+	// fixed seed, the same list always gives the same model
+	vector<int> idx(n);
+	iota(idx.begin(), idx.end(), 0);
+	RNG rng(0x5446);
+	for (int i = n - 1; i > 0; --i)
+	{
+		swap(idx[i], idx[rng.uniform(0, i + 1)]);
+	}
+
+	int nHold = int(n * fHoldOut);
+	if (nHold < 1 || n - nHold < 1) nHold = 0;
+	int nTrain = n - nHold;
+
+	Mat1f Xt(nTrain, D), yt(nTrain, 1), Xh(max(nHold, 1), D), yh(max(nHold, 1), 1);
+	for (int i = 0; i < n; ++i)
+	{
+		bool bHold = i >= nTrain;
+		int r = bHold ? i - nTrain : i;
+		F.row(idx[i]).copyTo(bHold ? Xh.row(r) : Xt.row(r));
+		(bHold ? yh : yt)(r, 0) = labels[idx[i]] ? 1.f : 0.f;
+	}
+
+	// logistic regression, full batch gradient descent with L2 regularization
+	_w = Mat1f::zeros(D, 1);
+	_b = 0.f;
+	Mat1f s, residual(nTrain, 1), grad;
+	for (int it = 0; it < iIterations; ++it)
+	{
+		gemm(Xt, _w, 1.0, Mat(), 0.0, s);
+		float sumResidual = 0.f;
+		for (int i = 0; i < nTrain; ++i)
+		{
+			residual(i, 0) = Sigmoid(s(i, 0) + _b) - yt(i, 0);
+			sumResidual += residual(i, 0);
+		}
+		gemm(Xt, residual, 1.0 / nTrain, _w, fLambda, grad, GEMM_1_T);
+		_w -= fLearningRate * grad;
+		_b -= fLearningRate * sumResidual / nTrain;
+	}
+
+	// Platt calibration on the held out scores (on the training scores if there are none)
+	const Mat1f& Xc = nHold ? Xh : Xt;
+	const Mat1f& yc = nHold ? yh : yt;
+	int nc = nHold ? nHold : nTrain;
+	gemm(Xc, _w, 1.0, Mat(), 0.0, s);
+
+	int nPos = 0;
+	for (int i = 0; i < nc; ++i) nPos += yc(i, 0) > 0.5f;
+	float tPos = (nPos + 1.f) / (nPos + 2.f);			// Platt's smoothed targets
+	float tNeg = 1.f / (nc - nPos + 2.f);
+
+	_plattA = 1.f;
+	_plattB = 0.f;
+	for (int it = 0; it < 1000; ++it)
+	{
+		float gA = 0.f, gB = 0.f;
+		for (int i = 0; i < nc; ++i)
+		{
+			float score = s(i, 0) + _b;
+			float d = Sigmoid(_plattA * score + _plattB) - (yc(i, 0) > 0.5f ? tPos : tNeg);
+			gA += d * score;
+			gB += d;
+		}
+		_plattA -= 0.1f * gA / nc;
+		_plattB -= 0.1f * gB / nc;
+	}
+
+	int nCorrect = 0;
+	for (int i = 0; i < nc; ++i)
+	{
+		float p = Sigmoid(_plattA * (s(i, 0) + _b) + _plattB);
+		nCorrect += (p > 0.5f) == (yc(i, 0) > 0.5f);
+	}
+	return float(nCorrect) / nc;
+}
+
+int TrainTFClassifier(const string& list, const string& model)
+{
+	ifstream in(list.c_str());
+	if (!in.is_open())
+	{
+		printf("cannot open sample list %s\n", list.c_str());
+		return EXIT_FAILURE;
+	}
+
+	//样本为extracrROI输出的灰度ROI(未二值化)
+	vector<Mat1b> rois;
+	vector<int> labels;
+	string path, label;
+	while (in >> path >> label)
+	{
+		Mat1b roi = imread(path, IMREAD_GRAYSCALE);
+		if (CTFClassifier::Degenerate(roi))
+		{
+			printf("skip %s\n", path.c_str());
+			continue;
+		}
+		//--dump-rois写出的列表中未标注的样本为"?"
+		int y = (label == "T" || label == "t" || label == "1") ? 1 : ((label == "F" || label == "f" || label == "0") ? 0 : -1);
+		if (y < 0) continue;
+		rois.push_back(roi);
+		labels.push_back(y);
+	}
+
+	int nT = accumulate(labels.begin(), labels.end(), 0);
+	printf("TF samples: %d T, %d F\n", nT, int(labels.size()) - nT);
+	if (nT == 0 || nT == int(labels.size()))
+	{
+		printf("both T and F samples are needed\n");
+		return EXIT_FAILURE;
+	}
+
+	CTFClassifier classifier;
+	float accuracy = classifier.Train(rois, labels);
+	printf("TF held out accuracy: %.3f\n", accuracy);
+
+	if (!classifier.Save(model))
+	{
+		printf("cannot write %s\n", model.c_str());
+		return EXIT_FAILURE;
+	}
+	printf("TF model written to %s\n", model.c_str());
+	return 0;
+}
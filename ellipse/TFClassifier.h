@@ -0,0 +1,68 @@
+/*
+Compact T/F classifier for the character ROIs.
+
+Each ROI is normalized to TF_CLS_SIZE x TF_CLS_SIZE (INTER_AREA) and described by a
+HOG vector. A linear model scores the whole batch with a single matrix product and
+the scores are mapped to P(T) by a Platt sigmoid fitted on held out samples.
+
+The model is trained offline (TrainTFClassifier, "--train-tf" on the command line)
+from a list of ROI crops and saved to a yml file read by CTFRecognizer. "--dump-rois"
+writes the crops of a video together with an unlabeled list to be filled in.
+*/
+
+#pragma once
+
+#include <cv.h>
+#include <opencv2/objdetect/objdetect.hpp>
+#include <vector>
+#include <string>
+
+using namespace std;
+using namespace cv;
+
+#define TF_CLS_SIZE 32		// side of the normalized ROI
+#define TF_CLS_MIN_SIDE 4	// smaller ROIs (clipped at the image border) are not scored
+
+class CTFClassifier
+{
+public:
+
+	CTFClassifier();
+
+	bool Load(const string& file);
+	bool Save(const string& file) const;
+	bool Empty() const { return _w.empty(); };
+
+	// Length of the feature vector
+	int FeatureSize() const { return int(_hog.getDescriptorSize()); };
+
+	// P(T) for every ROI (gray, not thresholded), -1 for an empty or degenerate ROI
+	static bool Degenerate(const Mat1b& roi) { return roi.rows < TF_CLS_MIN_SIDE || roi.cols < TF_CLS_MIN_SIDE; };
+	void PredictBatch(const vector<Mat1b>& rois, vector<float>& probT);
+
+	// Logistic regression on 1 - fHoldOut of the samples, Platt calibration on the rest.
+	// labels: 1 T, 0 F. Returns the accuracy on the held out samples.
+	float Train(const vector<Mat1b>& rois, const vector<int>& labels, int iIterations = 500,
+				float fLearningRate = 0.5f, float fLambda = 1e-3f, float fHoldOut = 0.2f);
+
+private:
+
+	// One row of features per ROI, zeros for a degenerate ROI
+	void ExtractBatch(const vector<Mat1b>& rois, Mat1f& features);
+
+	HOGDescriptor _hog;
+
+	Mat1f	_w;			// D x 1 weights
+	float	_b;
+	float	_plattA;	// P(T) = 1 / (1 + exp(-(_plattA * score + _plattB)))
+	float	_plattB;
+
+	// buffers reused between batches
+	Mat1b	_norm;
+	vector<float> _desc;
+	Mat1f	_features;
+	Mat1f	_scores;
+};
+
+// 离线训练：list每行为"图片路径 标签"，标签为T/F或1/0(其他标签跳过)，结果写入model
+int TrainTFClassifier(const string& list, const string& model);
@@ -0,0 +1,557 @@
+#include "TFRecognizer.h"
+#include <highgui.h>
+#include <cfloat>
+
+class TFRecognizeBody : public ParallelLoopBody
+{
+	const CTFRecognizer* _rec;
+	vector<CTFRecognizer::Slot>* _slots;
+	const vector<int>* _todo;
+	const vector<Mat1b>* _rois;
+	const vector<coordinate>* _ellipses;
+
+public:
+
+	TFRecognizeBody(const CTFRecognizer* rec, vector<CTFRecognizer::Slot>* slots, const vector<int>* todo,
+					const vector<Mat1b>* rois, const vector<coordinate>* ellipses) :
+		_rec(rec), _slots(slots), _todo(todo), _rois(rois), _ellipses(ellipses) {}
+
+	void operator()(const Range& range) const
+	{
+		for (int k = range.start; k < range.end; ++k)
+		{
+			int j = (*_todo)[k];
+			_rec->RecognizeOne((*_slots)[j], (*_rois)[j], (*_ellipses)[j]);
+		}
+	}
+};
+
+
+CTFRecognizer::CTFRecognizer() : _iThMode(TF_TH_SINGLE), _bOtsu(false),
+	_fTplCrop(0.6f), _fTplMinScore(0.4f), _fHeadingOffset(0.f), _fHeading(0.f), _fRoiScale(3.f),
+	_bCache(false), _fCacheMaxSad(6.f), _iCacheMaxAge(15), _fCacheMaxShift(1.f), _iRoiThreshold(0)
+{
+}
+
+// Bright character on a dark background, centered, about 80% of the template
+static Mat1b DrawTemplate(const string& text)
+{
+	Mat1b tpl(TF_TPL_SIZE, TF_TPL_SIZE, uchar(0));
+	int thickness = 4, baseline = 0;
+	Size sz = getTextSize(text, FONT_HERSHEY_SIMPLEX, 1.0, thickness, &baseline);
+	double scale = 0.8 * TF_TPL_SIZE / max(sz.width, sz.height);
+	sz = getTextSize(text, FONT_HERSHEY_SIMPLEX, scale, thickness, &baseline);
+	Point org((TF_TPL_SIZE - sz.width) / 2, (TF_TPL_SIZE + sz.height) / 2);
+	putText(tpl, text, org, FONT_HERSHEY_SIMPLEX, scale, Scalar(255), thickness);
+	GaussianBlur(tpl, tpl, Size(3, 3), 0, 0);
+	return tpl;
+}
+
+static bool LoadTemplate(const string& file, Mat1b& tpl)
+{
+	Mat1b img = imread(file, IMREAD_GRAYSCALE);
+	if (img.empty()) return false;
+	resize(img, tpl, Size(TF_TPL_SIZE, TF_TPL_SIZE), 0, 0, INTER_AREA);
+	return true;
+}
+
+bool CTFRecognizer::SetTemplates(const string& fileT, const string& fileF, float fCrop, float fMinScore, float fHeadingOffset)
+{
+	Mat1b tplT, tplF;
+	if (fileT.empty()) tplT = DrawTemplate("T");
+	else if (!LoadTemplate(fileT, tplT)) return false;
+	if (fileF.empty()) tplF = DrawTemplate("F");
+	else if (!LoadTemplate(fileF, tplF)) return false;
+
+	_tplT = tplT;
+	_tplF = tplF;
+	_fTplCrop = fCrop;
+	_fTplMinScore = fMinScore;
+	_fHeadingOffset = fHeadingOffset;
+	_iThMode = TF_TH_TEMPLATE;
+	return true;
+}
+
+void CTFRecognizer::SetEnsemble(const vector<int>& thresholds, bool bOtsu)
+{
+	_thresholds = thresholds;
+	sort(_thresholds.begin(), _thresholds.end());
+	_thresholds.erase(unique(_thresholds.begin(), _thresholds.end()), _thresholds.end());
+	if (int(_thresholds.size()) + (bOtsu ? 1 : 0) > TF_MAX_THRESHOLDS)
+	{
+		_thresholds.resize(TF_MAX_THRESHOLDS - (bOtsu ? 1 : 0));
+	}
+	_bOtsu = bOtsu;
+	_iThMode = (_thresholds.empty() && !_bOtsu) ? TF_TH_SINGLE : TF_TH_ENSEMBLE;
+}
+
+bool CTFRecognizer::SetClassifier(const string& model)
+{
+	if (!_classifier.Load(model)) return false;
+	_iThMode = TF_TH_CLASSIFIER;
+	return true;
+}
+
+void CTFRecognizer::Read(const FileNode& node)
+{
+	if (node.empty()) return;
+
+	FileNode cache = node["cache"];
+	if (!cache.empty())
+	{
+		SetCache(cache["enabled"].empty() ? true : ((int)cache["enabled"] != 0),
+				 cache["sad"].empty() ? _fCacheMaxSad : (float)cache["sad"],
+				 cache["max_age"].empty() ? _iCacheMaxAge : (int)cache["max_age"],
+				 cache["max_shift"].empty() ? _fCacheMaxShift : (float)cache["max_shift"]);
+	}
+
+	string mode = (string)node["mode"];
+	if (mode == "template")
+	{
+		string fileT = (string)node["template_t"];
+		string fileF = (string)node["template_f"];
+		float crop = node["template_crop"].empty() ? 0.6f : (float)node["template_crop"];
+		float score = node["template_score"].empty() ? 0.4f : (float)node["template_score"];
+		float offset = node["heading_offset"].empty() ? 0.f : (float)node["heading_offset"];
+		if (SetTemplates(fileT, fileF, crop, score, offset)) return;
+		cout << "TF templates not loaded, using the threshold ensemble" << endl;
+		mode = "ensemble";
+	}
+	if (mode == "classifier")
+	{
+		string model = node["model"].empty() ? string("tf_model.yml") : (string)node["model"];
+		if (SetClassifier(model)) return;
+		cout << "TF model " << model << " not loaded, using the threshold ensemble" << endl;
+		mode = "ensemble";
+	}
+	if (mode != "ensemble")
+	{
+		SetSingleThreshold();
+		return;
+	}
+	vector<int> thresholds;
+	FileNode th = node["thresholds"];
+	for (size_t i = 0; i < th.size(); ++i)
+	{
+		thresholds.push_back((int)th[int(i)]);
+	}
+	SetEnsemble(thresholds, node["otsu"].empty() ? true : ((int)node["otsu"] != 0));
+}
+
+void CTFRecognizer::Recognize(vector<Mat1b>& rois, vector<coordinate>& ellipse_in, vector<coordinate>& ellipse_out, vector< vector<Point> >& contours)
+{
+	int n = int(min(rois.size(), ellipse_in.size()));
+	if (n == 0) return;
+
+	double t0 = (double)getTickCount();
+
+	if (int(_slots.size()) < n)
+	{
+		_slots.resize(n);
+	}
+
+	//已关联目标且ROI内容几乎没变的沿用上次的识别结果，其余的重新识别
+	_todo.clear();
+	for (int j = 0; j < n; ++j)
+	{
+		_slots[j].bCached = LookupCache(_slots[j], rois[j], ellipse_in[j]);
+		if (!_slots[j].bCached)
+		{
+			_todo.push_back(j);
+		}
+	}
+
+	if (_iThMode == TF_TH_CLASSIFIER)
+	{
+		//需要识别的ROI一次批量计算特征和得分
+		_batch.clear();
+		for (size_t k = 0; k < _todo.size(); ++k)
+		{
+			_batch.push_back(rois[_todo[k]]);
+		}
+		_classifier.PredictBatch(_batch, _probT);
+		for (size_t k = 0; k < _todo.size(); ++k)
+		{
+			Slot& slot = _slots[_todo[k]];
+			slot.nBoxes = 0;
+			slot.votesT = 0;
+			slot.votesF = 0;
+			slot.probT = _probT[k];
+			//边界处截断的ROI不参与识别，保持未识别
+			if (_probT[k] < 0.f)
+			{
+				slot.flag = 2;
+				slot.conf = 0.f;
+				continue;
+			}
+			slot.flag = _probT[k] > 0.5f ? 1 : 0;
+			slot.conf = abs(2.f * _probT[k] - 1.f);
+		}
+	}
+	else if (!_todo.empty())
+	{
+		parallel_for_(Range(0, int(_todo.size())), TFRecognizeBody(this, &_slots, &_todo, &rois, &ellipse_in));
+	}
+
+	for (size_t k = 0; k < _todo.size(); ++k)
+	{
+		UpdateCache(_slots[_todo[k]], ellipse_in[_todo[k]]);
+	}
+
+	//按ROI顺序合并结果
+	for (int j = 0; j < n; ++j)
+	{
+		Slot& slot = _slots[j];
+		ellipse_in[j].flag = slot.flag;
+		ellipse_in[j].votesT = slot.votesT;
+		ellipse_in[j].votesF = slot.votesF;
+		ellipse_in[j].conf = slot.conf;
+		ellipse_in[j].probT = slot.probT;
+		ellipse_in[j].cached = slot.bCached;
+		for (int k = 0; k < slot.nBoxes; ++k)
+		{
+			vector<Point> contour(4);
+			for (int i = 0; i < 4; ++i)
+			{
+				contour[i] = slot.boxes[k][i];
+			}
+			contours.push_back(contour);
+		}
+		ellipse_out.push_back(ellipse_in[j]);
+	}
+
+	_stats.uFrames++;
+	_stats.uRois += n;
+	_stats.uCacheHits += n - _todo.size();
+	_stats.dTimeMs += ((double)getTickCount() - t0) * 1000. / getTickFrequency();
+}
+
+void CTFRecognizer::SetCache(bool bEnabled, float fMaxSad, int iMaxAge, float fMaxShift)
+{
+	_bCache = bEnabled;
+	_fCacheMaxSad = fMaxSad;
+	_iCacheMaxAge = iMaxAge;
+	_fCacheMaxShift = fMaxShift;
+	_cache.clear();
+}
+
+bool CTFRecognizer::LookupCache(Slot& slot, const Mat1b& roi, const coordinate& e)
+{
+	if (!_bCache || e.target < 0) return false;
+	if (roi.empty())
+	{
+		slot.sig.release();
+		return false;
+	}
+
+	resize(roi, slot.sig, Size(TF_CACHE_SIG, TF_CACHE_SIG), 0, 0, INTER_AREA);
+
+	if (int(_cache.size()) <= e.target * TF_CACHE_WAYS) return false;
+	//只与同一阈值二值化的上一个ROI比较
+	TFCacheEntry* pEntry = NULL;
+	for (int w = 0; w < TF_CACHE_WAYS; ++w)
+	{
+		TFCacheEntry& way = _cache[e.target * TF_CACHE_WAYS + w];
+		if (way.bValid && way.iThreshold == _iRoiThreshold)
+		{
+			pEntry = &way;
+			break;
+		}
+	}
+	if (pEntry == NULL) return false;
+	TFCacheEntry& entry = *pEntry;
+
+	//目标移动过多时重新识别
+	if (abs(entry.locx - e.locx) > _fCacheMaxShift || abs(entry.locy - e.locy) > _fCacheMaxShift) return false;
+	//强制定期重新识别
+	if (++entry.iAge > _iCacheMaxAge) return false;
+	//平均每像素灰度差
+	if (norm(slot.sig, entry.sig, NORM_L1) > _fCacheMaxSad * TF_CACHE_SIG * TF_CACHE_SIG) return false;
+
+	slot.flag = entry.flag;
+	slot.votesT = entry.votesT;
+	slot.votesF = entry.votesF;
+	slot.conf = entry.conf;
+	slot.probT = entry.probT;
+	slot.nBoxes = 0;
+	return true;
+}
+
+void CTFRecognizer::UpdateCache(const Slot& slot, const coordinate& e)
+{
+	if (!_bCache || e.target < 0 || slot.sig.empty()) return;
+
+	if (int(_cache.size()) < (e.target + 1) * TF_CACHE_WAYS)
+	{
+		_cache.resize((e.target + 1) * TF_CACHE_WAYS);
+	}
+	//同一阈值的条目，没有时用空的或较旧的一个
+	TFCacheEntry* ways = &_cache[e.target * TF_CACHE_WAYS];
+	int w = 0;
+	for (int k = 0; k < TF_CACHE_WAYS; ++k)
+	{
+		if (ways[k].bValid && ways[k].iThreshold == _iRoiThreshold)
+		{
+			w = k;
+			break;
+		}
+		if (!ways[k].bValid || (ways[w].bValid && ways[k].iAge > ways[w].iAge))
+		{
+			w = k;
+		}
+	}
+	TFCacheEntry& entry = ways[w];
+	entry.bValid = true;
+	entry.iThreshold = _iRoiThreshold;
+	slot.sig.copyTo(entry.sig);
+	entry.locx = e.locx;
+	entry.locy = e.locy;
+	entry.iAge = 0;
+	entry.flag = slot.flag;
+	entry.votesT = slot.votesT;
+	entry.votesF = slot.votesF;
+	entry.conf = slot.conf;
+	entry.probT = slot.probT;
+}
+
+static inline uchar SampleRoi(const Mat1b& roi, float x, float y)
+{
+	int ix = min(max(int(x), 0), roi.cols - 1);
+	int iy = min(max(int(y), 0), roi.rows - 1);
+	return roi(iy, ix);
+}
+
+void CTFRecognizer::RecognizeOne(Slot& slot, const Mat1b& roi, const coordinate& e) const
+{
+	slot.nBoxes = 0;
+	slot.votesT = 0;
+	slot.votesF = 0;
+	slot.conf = 0.f;
+	slot.probT = -1.f;
+	if (roi.empty())
+	{
+		slot.flag = e.flag;
+		return;
+	}
+
+	if (_iThMode == TF_TH_ENSEMBLE)
+	{
+		RecognizeEnsemble(slot, roi, e);
+		return;
+	}
+	if (_iThMode == TF_TH_TEMPLATE)
+	{
+		RecognizeTemplate(slot, roi, e);
+		return;
+	}
+
+	//单阈值：没有找到字符时保留原flag
+	uchar flag = RecognizeBinary(slot, roi, e, true);
+	slot.flag = (flag == 2) ? e.flag : flag;
+}
+
+// Otsu threshold from a 256 bin histogram, same criterion as THRESH_OTSU
+static int OtsuFromHistogram(const int* hist, int total)
+{
+	double mu = 0.0;
+	for (int i = 0; i < 256; ++i) mu += double(i) * hist[i];
+	mu /= total;
+
+	double q1 = 0.0, mu1 = 0.0, maxSigma = 0.0;
+	int th = 0;
+	for (int i = 0; i < 256; ++i)
+	{
+		double p_i = double(hist[i]) / total;
+		double q2;
+		mu1 *= q1;
+		q1 += p_i;
+		q2 = 1. - q1;
+		if (min(q1, q2) < FLT_EPSILON || max(q1, q2) > 1. - FLT_EPSILON) continue;
+
+		mu1 = (mu1 + i * p_i) / q1;
+		double mu2 = (mu - q1 * mu1) / q2;
+		double sigma = q1 * q2 * (mu1 - mu2) * (mu1 - mu2);
+		if (sigma > maxSigma)
+		{
+			maxSigma = sigma;
+			th = i;
+		}
+	}
+	return th;
+}
+
+void CTFRecognizer::RecognizeEnsemble(Slot& slot, const Mat1b& roi, const coordinate& e) const
+{
+	//一次遍历得到灰度直方图，Otsu阈值及阈值之间的像素个数都由它计算
+	memset(slot.hist, 0, sizeof(slot.hist));
+	for (int y = 0; y < roi.rows; ++y)
+	{
+		const uchar* row = roi[y];
+		for (int x = 0; x < roi.cols; ++x)
+		{
+			slot.hist[row[x]]++;
+		}
+	}
+
+	int th[TF_MAX_THRESHOLDS];
+	int n = 0;
+	for (size_t i = 0; i < _thresholds.size(); ++i)
+	{
+		th[n++] = _thresholds[i];
+	}
+	if (_bOtsu)
+	{
+		int otsu = OtsuFromHistogram(slot.hist, roi.rows * roi.cols);
+		int k = n++;
+		for (; k > 0 && th[k - 1] > otsu; --k) th[k] = th[k - 1];
+		th[k] = otsu;
+	}
+
+	//与上一个识别过的阈值之间的像素少于TF_ENSEMBLE_MIN_DIFF时二值图(几乎)相同，
+	//结果完全相关，不再识别也不再投票；Otsu落在固定阈值上或紧邻时同样只计一次
+	int minDiff = max(int(TF_ENSEMBLE_MIN_DIFF * roi.rows * roi.cols), 1);
+	int nDistinct = 0;
+	int last = -1;
+	for (int k = 0; k < n; ++k)
+	{
+		if (last >= 0)
+		{
+			int diff = 0;
+			for (int v = max(last + 1, 0); v <= min(th[k], 255); ++v) diff += slot.hist[v];
+			if (diff < minDiff) continue;
+		}
+		threshold(roi, slot.bin, th[k], 255, CV_THRESH_BINARY);
+		uchar flag = RecognizeBinary(slot, slot.bin, e, last < 0);
+		last = th[k];
+		nDistinct++;
+		if (flag == 1) slot.votesT++;
+		else if (flag == 0) slot.votesF++;
+	}
+
+	//各阈值的结果合并为这一帧的一次观测：多数决定flag，conf为票数差占不同二值图个数的比例
+	if (slot.votesT > slot.votesF) slot.flag = 1;
+	else if (slot.votesF > slot.votesT) slot.flag = 0;
+	else slot.flag = 2;
+	slot.conf = nDistinct ? float(abs(int(slot.votesT) - int(slot.votesF))) / nDistinct : 0.f;
+}
+
+void CTFRecognizer::RecognizeTemplate(Slot& slot, const Mat1b& roi, const coordinate& e) const
+{
+	//图像上方为机头方向，顺时针转过航向角后为地面上字符的原始方向；
+	//旋转、裁剪中心区域和缩放到TF_TPL_WINDOW一次warpAffine完成
+	Point2f c(roi.cols * 0.5f, roi.rows * 0.5f);
+	double scale = TF_TPL_WINDOW / (_fTplCrop * roi.cols);
+	Mat M = getRotationMatrix2D(c, -(_fHeading + _fHeadingOffset), scale);
+	M.at<double>(0, 2) += TF_TPL_WINDOW * 0.5 - c.x;
+	M.at<double>(1, 2) += TF_TPL_WINDOW * 0.5 - c.y;
+	warpAffine(roi, slot.norm, M, Size(TF_TPL_WINDOW, TF_TPL_WINDOW), INTER_LINEAR, BORDER_REPLICATE);
+
+	//窗口比模板大，允许字符有几个像素的偏移
+	double scoreT, scoreF;
+	matchTemplate(slot.norm, _tplT, slot.match, TM_CCOEFF_NORMED);
+	minMaxLoc(slot.match, 0, &scoreT);
+	matchTemplate(slot.norm, _tplF, slot.match, TM_CCOEFF_NORMED);
+	minMaxLoc(slot.match, 0, &scoreF);
+
+	if (max(scoreT, scoreF) < _fTplMinScore)
+	{
+		slot.flag = 2;
+		return;
+	}
+	slot.flag = scoreT > scoreF ? 1 : 0;
+	slot.conf = float(abs(scoreT - scoreF));
+}
+
+uchar CTFRecognizer::RecognizeBinary(Slot& slot, const Mat1b& roi, const coordinate& e, bool bKeepBoxes) const
+{
+	float areanum = 0.215;
+	uchar flag = 2;
+
+	roi.copyTo(slot.work);
+	findContours(slot.work, slot.contours, CV_RETR_LIST, CV_CHAIN_APPROX_NONE);
+
+	float h1_s, h2_s, h3_s, h4, h1_b, h2_b, h3_b;
+	/*****************************************************************
+	 * 大圆的参数
+	*****************************************************************/
+	//尺寸按ROI边长计，与ROI取自哪种分辨率的图像无关(ROI边长为2*缩放倍数*e.a，原来按3倍写作0.6a、0.9a)
+	h1_b = 0.1 * roi.cols;
+	h2_b = 0.15 * roi.cols;
+	h3_b = 0.16 * roi.cols;//0.55
+	h4 = 0.5 * roi.cols;
+	/*****************************************************************
+	 * 小圆的参数
+	*****************************************************************/
+	h1_s = 0.3 * roi.cols;//原来按3倍写作1.8a、3a
+	h2_s = 0.5 * roi.cols;
+	h3_s = 0.55 * roi.cols;//0.55
+
+	for (size_t i = 0; i < slot.contours.size(); i++) {
+		//拟合出轮廓外侧最小的矩形
+		RotatedRect rotate_rect = minAreaRect(slot.contours[i]);
+		if (!((rotate_rect.size.height > h1_s && rotate_rect.size.height < h2_s && rotate_rect.size.width > h1_s &&
+			   rotate_rect.size.width < h2_s && abs(rotate_rect.center.x - h4) < h3_s &&
+			   abs(rotate_rect.center.y - h4) < h3_s)
+			  || (rotate_rect.size.height > h1_b && rotate_rect.size.height < h2_b && rotate_rect.size.width > h1_b &&
+				  rotate_rect.size.width < h2_b && abs(rotate_rect.center.x - h4) < h3_b &&
+				  abs(rotate_rect.center.y - h4) < h3_b)))
+			continue;
+
+		Point2f vertices[4];
+		rotate_rect.points(vertices);
+
+		float x12 = (vertices[1].x + vertices[2].x) / 2;
+		float y12 = (vertices[1].y + vertices[2].y) / 2;
+		float xt12 = areanum * (rotate_rect.center.x - x12) + x12;
+		float yt12 = y12 - areanum * (y12 - rotate_rect.center.y);
+
+		float x30 = (vertices[3].x + vertices[0].x) / 2;
+		float y30 = (vertices[3].y + vertices[0].y) / 2;
+		float yt30 = areanum * (rotate_rect.center.y - y30) + y30;
+		float xt30 = x30 - areanum * (x30 - rotate_rect.center.x);
+
+		float x23 = (vertices[2].x + vertices[3].x) / 2;
+		float y23 = (vertices[2].y + vertices[3].y) / 2;
+		float xt23 = areanum * (rotate_rect.center.x - x23) + x23;
+		float yt23 = y23 - areanum * (y23 - rotate_rect.center.y);
+
+		float x01 = (vertices[1].x + vertices[0].x) / 2;
+		float y01 = (vertices[1].y + vertices[0].y) / 2;
+		float yt01 = areanum * (rotate_rect.center.y - y01) + y01;
+		float xt01 = x01 - areanum * (x01 - rotate_rect.center.x);
+
+		if (abs(SampleRoi(roi, xt12, yt12) - SampleRoi(roi, xt30, yt30)) < 60
+			&& abs(SampleRoi(roi, xt23, yt23) - SampleRoi(roi, xt01, yt01)) < 60) {
+			flag = 1;
+		} else {
+			flag = 0;
+		}
+
+		if (bKeepBoxes && slot.nBoxes < TF_MAX_BOXES) {
+			//ROI左上角，与extracrROI的取整一致
+			int r = roi.cols / 2;
+			int x_l = _fRoiScale * e.x - r;
+			int y_l = _fRoiScale * e.y - r;
+			for (int k = 0; k < 4; k++) {
+				slot.boxes[slot.nBoxes][k].x = vertices[k].x + x_l;
+				slot.boxes[slot.nBoxes][k].y = vertices[k].y + y_l;
+			}
+			slot.nBoxes++;
+		}
+	}
+	return flag;
+}
+
+static CTFRecognizer tf_recognizer;
+
+CTFRecognizer& visual_rec_recognizer(){
+	return tf_recognizer;
+}
+
+void visual_rec(vector<Mat1b>& gray, vector<coordinate>& ellipse_out0, vector<coordinate>& ellipse_out00, vector< vector<Point> >& contours0){
+	tf_recognizer.Recognize(gray, ellipse_out0, ellipse_out00, contours0);
+}
+
+const TFRecStats& visual_rec_stats(){
+	return tf_recognizer.GetStats();
+}
@@ -0,0 +1,197 @@
+/*
+T/F character recognition on the binarized ROIs around the detected targets.
+
+The ROIs of a frame are processed in parallel (cv::parallel_for_). Every ROI has
+its own slot with a reusable binary image and contour buffer, and the per contour
+work only uses fixed size data on the stack, so in steady state a frame does not
+allocate anything but the output vectors.
+
+In ensemble mode the ROIs are not thresholded by extracrROI: each ROI is binarized
+with several thresholds (fixed ones and Otsu, all from one histogram pass). Thresholds
+whose binary image differs from the previous one by less than TF_ENSEMBLE_MIN_DIFF of
+the pixels are skipped. The votes of the distinct binarizations are fused into one
+observation per frame: the majority flag and conf = |votesT - votesF| / distinct.
+The binarizations of one ROI are strongly correlated, so the tracker credits the fused
+observation with at most logit(p_vote) (1.39 for p_vote 0.8, against 1.10 for a single
+threshold result with p_flag 0.75): a frame's result is more robust to the lighting,
+but a target is not decided in many fewer frames. The mode stays off by default
+until p_vote has been calibrated on replays.
+
+In classifier mode all the ROIs of a frame are scored in one batch by CTFClassifier and
+the calibrated P(T) is accumulated per target as log odds.
+
+In template mode each ROI is rotated by the vehicle heading (so the characters keep the
+orientation they have on the ground) and resampled to TF_TPL_WINDOW with one warpAffine,
+then matched with a single T and a single F template (TM_CCOEFF_NORMED). No contours.
+*/
+
+#pragma once
+
+#include <cv.h>
+#include <vector>
+
+#include "common.h"
+#include "EllipseDetectorYaed.h"
+#include "TFClassifier.h"
+
+using namespace std;
+using namespace cv;
+
+#define TF_MAX_BOXES 8		// character boxes kept per ROI for display
+#define TF_MAX_THRESHOLDS 8	// thresholds evaluated per ROI in ensemble mode
+#define TF_TPL_SIZE 32		// side of the T/F templates
+#define TF_TPL_WINDOW 40	// side of the de-rotated ROI window searched by the templates
+#define TF_CACHE_SIG 16		// side of the ROI signature compared by the recognition cache
+#define TF_CACHE_WAYS 2		// cache entries per target, one per ROI threshold (170 / 190 alternate)
+#define TF_ENSEMBLE_MIN_DIFF 0.01f	// fraction of ROI pixels two thresholds must separate to both vote
+
+// How the ROIs are binarized
+enum {
+	TF_TH_SINGLE = 0,		// ROIs come already thresholded (extracrROI, 170/190 on alternate frames)
+	TF_TH_ENSEMBLE = 1,		// ROIs come blurred, every threshold of the ensemble votes
+	TF_TH_CLASSIFIER = 2,	// ROIs come blurred, P(T) from the trained classifier (no thresholds)
+	TF_TH_TEMPLATE = 3		// ROIs come blurred, de-rotated by the heading and matched with T/F templates
+};
+
+// Recognition throughput, see CTFRecognizer::GetStats
+struct TFRecStats
+{
+	uint64_t	uFrames;
+	uint64_t	uRois;
+	uint64_t	uCacheHits;		// ROIs whose result came from the cache
+	double		dTimeMs;
+
+	TFRecStats() : uFrames(0), uRois(0), uCacheHits(0), dTimeMs(0.0) {}
+};
+
+// Last recognition of a target, see CTFRecognizer::SetCache
+struct TFCacheEntry
+{
+	bool	bValid;
+	int		iThreshold;		// threshold of the binarized ROI (see SetRoiThreshold), 0 gray
+	Mat1b	sig;			// TF_CACHE_SIG x TF_CACHE_SIG INTER_AREA thumbnail of the ROI
+	float	locx;			// target location when it was recognized
+	float	locy;
+	int		iAge;			// frames served from the cache since then
+	uchar	flag;
+	uchar	votesT;
+	uchar	votesF;
+	float	conf;
+	float	probT;
+
+	TFCacheEntry() : bValid(false), iThreshold(0), locx(0), locy(0), iAge(0), flag(2), votesT(0), votesF(0), conf(0), probT(-1) {}
+};
+
+class CTFRecognizer
+{
+public:
+
+	// Per ROI working data, reused from frame to frame
+	struct Slot
+	{
+		Mat1b	bin;						// binarized ROI (ensemble mode)
+		Mat1b	work;						// copy given to findContours, ROIs may overlap
+		vector< vector<Point> > contours;
+		int		hist[256];					// gray histogram of the ROI (ensemble mode)
+		Mat1b	norm;						// de-rotated window (template mode)
+		Mat1f	match;						// matchTemplate result (template mode)
+		Mat1b	sig;						// cache signature of the ROI
+		uchar	flag;						// 0 F, 1 T, 2 not recognized
+		uchar	votesT;						// distinct binarizations voting T / F (ensemble mode)
+		uchar	votesF;
+		float	conf;
+		float	probT;						// classifier P(T), -1 in the other modes
+		bool	bCached;					// result copied from the cache, not a new recognition
+		int		nBoxes;
+		Point2f	boxes[TF_MAX_BOXES][4];		// character boxes, frame coordinates
+	};
+
+	CTFRecognizer();
+
+	// Same contract as visual_rec
+	void Recognize(vector<Mat1b>& rois, vector<coordinate>& ellipse_in, vector<coordinate>& ellipse_out, vector< vector<Point> >& contours);
+
+	// Recognize a single ROI into its slot (thread safe on distinct slots)
+	void RecognizeOne(Slot& slot, const Mat1b& roi, const coordinate& e) const;
+
+	// Evaluate the given fixed thresholds, plus Otsu if bOtsu, on every ROI
+	void SetEnsemble(const vector<int>& thresholds, bool bOtsu);
+	void SetSingleThreshold() { _iThMode = TF_TH_SINGLE; };
+
+	// Use the trained classifier of the given model file, false if it cannot be loaded
+	bool SetClassifier(const string& model);
+
+	// Match T/F templates. Empty file names: the templates are drawn with putText.
+	// fCrop: side of the matched window as a fraction of the ROI side
+	bool SetTemplates(const string& fileT, const string& fileF, float fCrop, float fMinScore, float fHeadingOffset);
+
+	// Reuse the last result of a target (coordinate::target) while its ROI signature differs by
+	// less than fMaxSad gray levels per pixel, for at most iMaxAge frames, and while the target
+	// has not moved more than fMaxShift meters. Reused results are marked coordinate::cached:
+	// they save CPU but are not new evidence, the target tracker does not count them as votes.
+	// Single mode alternates the ROI threshold from frame to frame, so every target keeps one
+	// entry per threshold and a ROI is only compared with the last one binarized the same way
+	void SetCache(bool bEnabled, float fMaxSad, int iMaxAge, float fMaxShift);
+	// Threshold extracrROI applied to this frame's ROIs (CEllipseDetectorYaed::GetRoiThreshold)
+	void SetRoiThreshold(int iThreshold) { _iRoiThreshold = iThreshold; };
+
+	// Vehicle heading in degrees (global_position_int.hdg / 100), used in template mode
+	void SetHeading(float fHeading) { _fHeading = fHeading; };
+	// Scale of the image the ROIs were cut from relative to the ellipse coordinates (the fScale
+	// given to extracrROI), used to place the character boxes in frame coordinates
+	void SetRoiScale(float fScale) { _fRoiScale = fScale; };
+	int GetThresholdMode() const { return _iThMode; };
+
+	// recognition: { mode: single|ensemble|classifier|template, thresholds: [ ... ], otsu: 0|1, model: file,
+	//				  template_t: file, template_f: file, template_crop: 0.6, template_score: 0.4, heading_offset: 0,
+	//				  cache: { enabled: 0|1, sad: 6, max_age: 15, max_shift: 1.0 } }
+	void Read(const FileNode& node);
+
+	const TFRecStats& GetStats() const { return _stats; }
+	void ResetStats() { _stats = TFRecStats(); }
+
+private:
+
+	// Decision on one binarized ROI: 0 F, 1 T, 2 no character found
+	uchar RecognizeBinary(Slot& slot, const Mat1b& roi, const coordinate& e, bool bKeepBoxes) const;
+
+	void RecognizeEnsemble(Slot& slot, const Mat1b& roi, const coordinate& e) const;
+
+	void RecognizeTemplate(Slot& slot, const Mat1b& roi, const coordinate& e) const;
+
+	// true if the slot was filled from the cache
+	bool LookupCache(Slot& slot, const Mat1b& roi, const coordinate& e);
+	void UpdateCache(const Slot& slot, const coordinate& e);
+
+	int			_iThMode;
+	vector<int>	_thresholds;		// sorted fixed thresholds of the ensemble
+	bool		_bOtsu;
+
+	CTFClassifier _classifier;
+	vector<float> _probT;			// classifier output of the current batch
+
+	Mat1b		_tplT;				// TF_TPL_SIZE templates, bright character on dark background
+	Mat1b		_tplF;
+	float		_fTplCrop;
+	float		_fTplMinScore;		// below this correlation the ROI is not recognized
+	float		_fHeadingOffset;	// orientation of the characters on the ground, degrees
+	float		_fHeading;
+	float		_fRoiScale;
+
+	bool		_bCache;
+	float		_fCacheMaxSad;
+	int			_iCacheMaxAge;
+	float		_fCacheMaxShift;
+	int			_iRoiThreshold;
+	vector<TFCacheEntry> _cache;	// TF_CACHE_WAYS entries per coordinate::target
+
+	vector<int>	_todo;				// ROIs recognized this frame (cache misses)
+	vector<Mat1b> _batch;			// their headers, classifier mode
+
+	vector<Slot> _slots;
+	TFRecStats	_stats;
+};
+
+// visual_rec 使用的识别器及其累计统计
+CTFRecognizer& visual_rec_recognizer();
+const TFRecStats& visual_rec_stats();
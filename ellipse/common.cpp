@@ -334,7 +334,7 @@ void Canny2(	InputArray image, OutputArray _edges,
 };
 
 
-void Labeling(Mat1b& image, vector<vector<Point> >& segments, int iMinLength)
+void Labeling(Mat1b& image, vector<vector<Point> >& segments, int iMinLength, vector<SegmentShape>* pShapes)
 {
 	#define RG_STACK_SIZE 2048
 
@@ -424,13 +424,16 @@ void Labeling(Mat1b& image, vector<vector<Point> >& segments, int iMinLength)
 				{
 					vector<Point> component;
 					component.reserve(sp3);
+					SegmentShape shape;
 
 					// etichetto il punto
 					for (i=0; i<sp3; i++){
 						// etichetto
 						component.push_back(stack3[i]);
+						if (pShapes) shape.Add(stack3[i]);
 					}
 					segments.push_back(component);
+					if (pShapes) pShapes->push_back(shape);
 				}
 			}
 		}
@@ -1014,7 +1017,7 @@ bool SortTopLeft2BottomRight(const Point& lhs, const Point& rhs)
 
 void cvCanny3(	const void* srcarr, void* dstarr,
 				void* dxarr, void* dyarr,
-                int aperture_size )
+                int aperture_size, CannyThresholds* pThresholds )
 {
     //cv::Ptr<CvMat> dx, dy;
     cv::AutoBuffer<char> buffer;
@@ -1059,62 +1062,85 @@ void cvCanny3(	const void* srcarr, void* dstarr,
     cvSobel( src, dx, 1, 0, aperture_size );
     cvSobel( src, dy, 0, 1, aperture_size );
 
-	Mat1f magGrad(size.height, size.width, 0.f);
-	float maxGrad(0);
-	float val(0);
-	for(i=0; i<size.height; ++i)
-	{
-		float* _pmag = magGrad.ptr<float>(i);
-		const short* _dx = (short*)(dx->data.ptr + dx->step*i);
-        const short* _dy = (short*)(dy->data.ptr + dy->step*i);
-		for(j=0; j<size.width; ++j)
-		{
-			val = float(abs(_dx[j]) + abs(_dy[j]));
-			_pmag[j] = val;
-			maxGrad = (val > maxGrad) ? val : maxGrad;
-		}
-	}
-	
-	//% Normalize for threshold selection
-	//normalize(magGrad, magGrad, 0.0, 1.0, NORM_MINMAX);
-
 	//% Determine Hysteresis Thresholds
-	
+
 	//set magic numbers
-	const int NUM_BINS = 64;	
+	const int NUM_BINS = 64;
 	const double percent_of_pixels_not_edges = 0.9;
 	const double threshold_ratio = 0.3;
 
-	//compute histogram
-	int bin_size = cvFloor(maxGrad / float(NUM_BINS) + 0.5f) + 1;
-	if (bin_size < 1) bin_size = 1;
-	int bins[NUM_BINS] = { 0 }; 
-	for (i=0; i<size.height; ++i) 
+	int low_thresh(0), high_thresh(0);
+
+	bool bHistogram = (pThresholds == 0) ||
+					  (pThresholds->iMode != CANNY_TH_CARRY) ||
+					  (pThresholds->iAge < 0) ||
+					  (pThresholds->iAge + 1 >= pThresholds->iRefresh);
+
+	if (bHistogram)
 	{
-		float *_pmag = magGrad.ptr<float>(i);
-		for(j=0; j<size.width; ++j)
+		// |dx|+|dy| is an integer bounded by the Sobel aperture, so a fine histogram
+		// over the whole range is filled in the same pass that finds the maximum,
+		// and regrouped afterwards into the NUM_BINS bins (no float magnitude image)
+		int iMaxMag = (aperture_size == 3) ? 2040 : ((aperture_size == 5) ? 24480 : 65534);
+		std::vector<int> hist(iMaxMag + 1, 0);
+		int maxGrad(0);
+		for(i=0; i<size.height; ++i)
 		{
-			int hgf = int(_pmag[j]);
-			bins[int(_pmag[j]) / bin_size]++;
+			const short* _dx = (short*)(dx->data.ptr + dx->step*i);
+			const short* _dy = (short*)(dy->data.ptr + dy->step*i);
+			for(j=0; j<size.width; ++j)
+			{
+				int val = abs(_dx[j]) + abs(_dy[j]);
+				hist[val]++;
+				maxGrad = (val > maxGrad) ? val : maxGrad;
+			}
 		}
-	}	
 
-	
-	
+		//compute histogram
+		int bin_size = cvFloor(float(maxGrad) / float(NUM_BINS) + 0.5f) + 1;
+		if (bin_size < 1) bin_size = 1;
 
-	//% Select the thresholds
-	float total(0.f);	
-	float target = float(size.height * size.width * percent_of_pixels_not_edges);
-	int low_thresh, high_thresh(0);
-	
-	while(total < target)
+		//% Select the thresholds
+		float total(0.f);
+		float target = float(size.height * size.width * percent_of_pixels_not_edges);
+		int v = 0;
+		while(total < target)
+		{
+			int v_end = min(v + bin_size, iMaxMag + 1);
+			for (; v < v_end; ++v)
+			{
+				total += hist[v];
+			}
+			high_thresh++;
+		}
+		high_thresh *= bin_size;
+		low_thresh = cvFloor(threshold_ratio * float(high_thresh));
+
+		if (pThresholds != 0)
+		{
+			if (pThresholds->iMode == CANNY_TH_PER_FRAME || pThresholds->iAge < 0)
+			{
+				pThresholds->fHigh = float(high_thresh);
+				pThresholds->fLow = float(low_thresh);
+			}
+			else
+			{
+				pThresholds->fHigh += pThresholds->fAlpha * (float(high_thresh) - pThresholds->fHigh);
+				pThresholds->fLow += pThresholds->fAlpha * (float(low_thresh) - pThresholds->fLow);
+				high_thresh = cvRound(pThresholds->fHigh);
+				low_thresh = cvRound(pThresholds->fLow);
+			}
+			pThresholds->iAge = 0;
+		}
+	}
+	else
 	{
-		total+= bins[high_thresh];
-		high_thresh++;
+		// reuse the thresholds of the previous frames
+		pThresholds->iAge++;
+		high_thresh = cvRound(pThresholds->fHigh);
+		low_thresh = cvRound(pThresholds->fLow);
 	}
-	high_thresh *= bin_size;
-	low_thresh = cvFloor(threshold_ratio * float(high_thresh));
-	
+
     if( flags & CV_CANNY_L2_GRADIENT )
     {
         Cv32suf ul, uh;
@@ -1345,7 +1371,7 @@ void cvCanny3(	const void* srcarr, void* dstarr,
 
 void Canny3(	InputArray image, OutputArray _edges,
 				OutputArray _sobel_x, OutputArray _sobel_y,
-                int apertureSize, bool L2gradient )
+                int apertureSize, bool L2gradient, CannyThresholds* pThresholds )
 {
     Mat src = image.getMat();
     _edges.create(src.size(), CV_8U);
@@ -1360,7 +1386,8 @@ void Canny3(	InputArray image, OutputArray _edges,
 
     cvCanny3(	&c_src, &c_dst, 
 				&c_dx, &c_dy,
-				apertureSize + (L2gradient ? CV_CANNY_L2_GRADIENT : 0));
+				apertureSize + (L2gradient ? CV_CANNY_L2_GRADIENT : 0),
+				pThresholds);
 };
 
 
@@ -84,9 +84,27 @@ void Canny2(	InputArray image, OutputArray _edges,
                 double threshold1, double threshold2,
                 int apertureSize, bool L2gradient );
 
+// Hysteresis thresholds selection for Canny3
+// CANNY_TH_PER_FRAME : thresholds from the gradient histogram of every frame
+// CANNY_TH_SMOOTHED  : histogram of every frame, exponential smoothing of the thresholds
+// CANNY_TH_CARRY     : histogram every iRefresh frames, smoothed thresholds reused in between
+enum { CANNY_TH_PER_FRAME = 0, CANNY_TH_SMOOTHED = 1, CANNY_TH_CARRY = 2 };
+
+struct CannyThresholds
+{
+	int		iMode;
+	float	fAlpha;		// weight of the newest histogram in the smoothing
+	int		iRefresh;	// frames between two histogram passes (CANNY_TH_CARRY)
+	float	fLow;
+	float	fHigh;
+	int		iAge;		// frames since the last histogram pass, -1 if never computed
+
+	CannyThresholds() : iMode(CANNY_TH_PER_FRAME), fAlpha(0.2f), iRefresh(10), fLow(0.f), fHigh(0.f), iAge(-1) {};
+};
+
 void Canny3(	InputArray image, OutputArray _edges,
 				OutputArray _sobel_x, OutputArray _sobel_y,
-                int apertureSize, bool L2gradient );
+                int apertureSize, bool L2gradient, CannyThresholds* pThresholds = 0 );
 
 
 float inline ed2(const Point& A, const Point& B)
@@ -100,7 +118,56 @@ float inline ed2f(const Point2f& A, const Point2f& B)
 }
 
 
-void Labeling(Mat1b& image, vector<vector<Point> >& segments, int iMinLength);
+// Shape of a labeled segment, accumulated while labeling.
+// The second order moments give the variances along the principal axes:
+// the range of the points along any direction is at least 2*sigma, and for
+// thin arcs and bands the side of the oriented box is close to sqrt(12)*sigma.
+struct SegmentShape
+{
+	int			n;
+	int			x0, y0;		// first point, sums are relative to it
+	long long	sx, sy, sxx, syy, sxy;
+
+	SegmentShape() : n(0), x0(0), y0(0), sx(0), sy(0), sxx(0), syy(0), sxy(0) {};
+
+	void Add(const Point& p)
+	{
+		if (n == 0)
+		{
+			x0 = p.x;
+			y0 = p.y;
+		}
+		long long x = p.x - x0;
+		long long y = p.y - y0;
+		sx += x;
+		sy += y;
+		sxx += x * x;
+		syy += y * y;
+		sxy += x * y;
+		++n;
+	};
+
+	// Variances along the major and minor principal axes
+	void Axes(float& fVarMajor, float& fVarMinor) const
+	{
+		if (n == 0)
+		{
+			fVarMajor = fVarMinor = 0.f;
+			return;
+		}
+		double mx = double(sx) / n;
+		double my = double(sy) / n;
+		double cxx = double(sxx) / n - mx * mx;
+		double cyy = double(syy) / n - my * my;
+		double cxy = double(sxy) / n - mx * my;
+		double tr = 0.5 * (cxx + cyy);
+		double det = std::sqrt(0.25 * (cxx - cyy) * (cxx - cyy) + cxy * cxy);
+		fVarMajor = float(tr + det);
+		fVarMinor = float(std::max(tr - det, 0.0));
+	};
+};
+
+void Labeling(Mat1b& image, vector<vector<Point> >& segments, int iMinLength, vector<SegmentShape>* pShapes = 0);
 void LabelingRect(Mat1b& image, VVP& segments, int iMinLength, vector<Rect>& bboxes);
 void Thinning(Mat1b& imgMask, uchar byF=255, uchar byB=0);
 
@@ -0,0 +1,138 @@
+/**
+ * @file frame_grabber.cpp
+ *
+ * @brief Capture thread keeping only the newest camera frame
+ *
+ */
+
+#include "frame_grabber.h"
+
+// ------------------------------------------------------------------------------
+//   Con/De structors
+// ------------------------------------------------------------------------------
+Frame_Grabber::
+Frame_Grabber(Frame_Source &source_, bool lossless_) :
+	source(source_), lossless(lossless_), clock(NULL), back(0), front(1), middle(2),
+	time_to_exit(false), eof(false), captured(0), skipped_total(0), last_seq(0)
+{
+}
+
+Frame_Grabber::
+~Frame_Grabber()
+{
+	stop();
+}
+
+void
+Frame_Grabber::
+set_replay(Replay_Clock *clock_, const Replay_Frame_Times &times_)
+{
+	clock = clock_;
+	times = times_;
+	lossless = clock->is_fast();
+}
+
+void
+Frame_Grabber::
+start()
+{
+	time_to_exit = false;
+	thread_grab = std::thread(&Frame_Grabber::grab_thread, this);
+}
+
+void
+Frame_Grabber::
+stop()
+{
+	interrupt();
+	std::lock_guard<std::mutex> lock(join_mutex);
+	if (thread_grab.joinable())
+		thread_grab.join();
+}
+
+void
+Frame_Grabber::
+interrupt()
+{
+	time_to_exit = true;
+	wake();
+}
+
+// ------------------------------------------------------------------------------
+//   Capture thread
+// ------------------------------------------------------------------------------
+void
+Frame_Grabber::
+grab_thread()
+{
+	uint64_t seq = 0;
+	while (!time_to_exit) {
+		Slot &slot = slots[back];
+		if (!source.read(slot.image, slot.encoded) || slot.image.empty())
+			break;
+		if (clock) {
+			// 回放：实时模式下等到该帧记录的时刻再发布
+			slot.log_us = times.at(seq);
+			clock->wait_frame(slot.log_us);
+		}
+		slot.stamp_us = get_monotonic_usec();
+		slot.seq = ++seq;
+		captured++;
+
+		if (lossless) {
+			// 上一帧还没被取走时等待
+			std::unique_lock<std::mutex> lock(mutex);
+			cond.wait(lock, [this] { return !(middle.load() & FRESH) || time_to_exit; });
+		}
+
+		// 发布：back与middle交换，并标记为新帧
+		int prev = middle.exchange(back | FRESH);
+		back = prev & ~FRESH;
+		wake();
+	}
+	eof = true;
+	if (clock)
+		clock->finish();
+	wake();
+}
+
+void
+Frame_Grabber::
+wake()
+{
+	// 先经过一次加锁，保证等待方不会在检查条件之后、进入等待之前错过通知
+	{ std::lock_guard<std::mutex> lock(mutex); }
+	cond.notify_all();
+}
+
+// ------------------------------------------------------------------------------
+//   Reader
+// ------------------------------------------------------------------------------
+bool
+Frame_Grabber::
+take(Mat3b &image, Mat1b &encoded, uint64_t &stamp_us, uint64_t &seq, uint64_t &skipped, uint64_t &log_us)
+{
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		cond.wait(lock, [this] { return (middle.load() & FRESH) || eof || time_to_exit; });
+	}
+	if (!(middle.load() & FRESH))
+		return false;
+
+	// front与middle交换，取到最新发布的一帧
+	int prev = middle.exchange(front);
+	front = prev & ~FRESH;
+	if (lossless)
+		wake();
+
+	Slot &slot = slots[front];
+	swap(image, slot.image);
+	swap(encoded, slot.encoded);
+	stamp_us = slot.stamp_us;
+	seq = slot.seq;
+	log_us = clock ? slot.log_us : 0;
+	skipped = (last_seq && seq > last_seq + 1) ? seq - last_seq - 1 : 0;
+	skipped_total += skipped;
+	last_seq = seq;
+	return true;
+}
@@ -0,0 +1,93 @@
+/**
+ * @file frame_grabber.h
+ *
+ * @brief Capture thread keeping only the newest camera frame
+ *
+ * The grabber reads the frame source as fast as it delivers and publishes every
+ * frame into a triple buffer: the grabber writes the back slot, the reader
+ * owns the front slot, and they exchange through the middle slot with one
+ * atomic operation. A frame the reader did not take before the next one
+ * arrived is overwritten (latest wins) and counted as skipped, so the vision
+ * loop never works on frames queued up in the driver.
+ *
+ */
+
+#ifndef FRAME_GRABBER_H_
+#define FRAME_GRABBER_H_
+
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "autopilot_interface.h"
+#include "replay.h"
+#include "frame_source.h"
+
+class Frame_Grabber
+{
+public:
+
+	// lossless: 不丢帧，读取方取走之前采集线程等待(回放视频文件时使用)
+	Frame_Grabber(Frame_Source &source_, bool lossless_ = false);
+	~Frame_Grabber();
+
+	// 回放录像：帧按记录的采集时刻在clock的时间线上发布，快速模式下不丢帧，须在start()之前调用
+	void set_replay(Replay_Clock *clock_, const Replay_Frame_Times &times_);
+
+	void start();
+	// 停止并等待采集线程结束，可重复调用；只由拥有者(采集阶段、析构)调用
+	void stop();
+	// 只通知采集线程和take()退出，不等待，可在其他线程调用
+	void interrupt();
+
+	// 等待一帧新图像，与image交换(不拷贝)，返回false表示视频结束或已停止
+	// encoded: 压缩帧源的JPEG数据(帧源映射内存上的Mat头)，其他帧源为空
+	// stamp_us: 采集时刻(单调时钟)；seq: 帧序号；skipped: 与上次取帧之间被覆盖的帧数
+	// log_us: 回放时该帧记录的采集时刻，流水线融合完这一帧后用它推进回放时钟，否则为0
+	bool take(Mat3b &image, Mat1b &encoded, uint64_t &stamp_us, uint64_t &seq, uint64_t &skipped, uint64_t &log_us);
+
+	uint64_t get_captured() const { return captured; }
+	uint64_t get_skipped() const { return skipped_total; }
+
+private:
+
+	struct Slot
+	{
+		Mat3b image;
+		Mat1b encoded;
+		uint64_t stamp_us;
+		uint64_t seq;
+		uint64_t log_us;                    // 回放时该帧记录的采集时刻
+
+		Slot() : stamp_us(0), seq(0), log_us(0) {}
+	};
+
+	void grab_thread();
+	void wake();
+
+	Frame_Source &source;
+	bool lossless;
+	Replay_Clock *clock;
+	Replay_Frame_Times times;
+
+	Slot slots[3];
+	int back;                               // 采集线程独占
+	int front;                              // 读取方独占
+	std::atomic<int> middle;                // 低2位为序号，FRESH表示有未取走的新帧
+	static const int FRESH = 4;
+
+	std::mutex mutex;                       // 只用于等待/唤醒
+	std::condition_variable cond;
+
+	std::atomic<bool> time_to_exit;
+	std::atomic<bool> eof;
+	std::atomic<uint64_t> captured;
+	std::atomic<uint64_t> skipped_total;
+	uint64_t last_seq;
+
+	std::thread thread_grab;
+	std::mutex join_mutex;                  // stop()只join一次
+};
+
+#endif // FRAME_GRABBER_H_
@@ -0,0 +1,147 @@
+/**
+ * @file frame_log.cpp
+ *
+ * @brief Binary per-frame log in a memory mapped ring file
+ *
+ */
+
+#include "frame_log.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+// ------------------------------------------------------------------------------
+//   Con/De structors
+// ------------------------------------------------------------------------------
+Frame_Log::
+Frame_Log(size_t queue_len) :
+	fd(-1), header(NULL), records(NULL), map_size(0), queue(queue_len), written(0), dropped(0)
+{
+}
+
+Frame_Log::
+~Frame_Log()
+{
+	stop();
+}
+
+// ------------------------------------------------------------------------------
+//   Open / Start / Stop
+// ------------------------------------------------------------------------------
+bool
+Frame_Log::
+open(const char *file, uint32_t capacity)
+{
+	if (capacity == 0)
+		return false;
+	fd = ::open(file, O_RDWR | O_CREAT, 0644);
+	if (fd < 0) {
+		printf("WARNING: could not open frame log %s\n", file);
+		return false;
+	}
+
+	map_size = sizeof(Frame_Log_Header) + size_t(capacity) * sizeof(Frame_Log_Record);
+	struct stat st;
+	bool reuse = fstat(fd, &st) == 0 && size_t(st.st_size) == map_size;
+	if (!reuse && ftruncate(fd, map_size) != 0) {
+		printf("WARNING: could not resize frame log %s\n", file);
+		::close(fd);
+		fd = -1;
+		return false;
+	}
+
+	void *map = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED) {
+		printf("WARNING: could not map frame log %s\n", file);
+		::close(fd);
+		fd = -1;
+		return false;
+	}
+	header = (Frame_Log_Header *)map;
+	records = (Frame_Log_Record *)((char *)map + sizeof(Frame_Log_Header));
+
+	// 格式不同(或新文件)时重新初始化
+	if (!reuse || header->magic != FRAME_LOG_MAGIC || header->version != FRAME_LOG_VERSION ||
+	    header->record_size != sizeof(Frame_Log_Record) || header->capacity != capacity) {
+		struct timeval tv;
+		gettimeofday(&tv, NULL);
+		memset(header, 0, sizeof(Frame_Log_Header));
+		header->magic = FRAME_LOG_MAGIC;
+		header->version = FRAME_LOG_VERSION;
+		header->record_size = sizeof(Frame_Log_Record);
+		header->capacity = capacity;
+		header->count = 0;
+		header->start_usec = tv.tv_sec * 1000000ULL + tv.tv_usec;
+	}
+	return true;
+}
+
+void
+Frame_Log::
+start()
+{
+	if (header)
+		thread_write = std::thread(&Frame_Log::write_thread, this);
+}
+
+void
+Frame_Log::
+stop()
+{
+	queue.close();
+	if (thread_write.joinable())
+		thread_write.join();
+	if (header) {
+		msync(header, map_size, MS_SYNC);
+		munmap(header, map_size);
+		header = NULL;
+		records = NULL;
+	}
+	if (fd >= 0) {
+		::close(fd);
+		fd = -1;
+	}
+}
+
+// ------------------------------------------------------------------------------
+//   Producer
+// ------------------------------------------------------------------------------
+bool
+Frame_Log::
+append(const Frame_Log_Record &record)
+{
+	if (!header || !queue.try_push(record)) {
+		dropped++;
+		return false;
+	}
+	return true;
+}
+
+// ------------------------------------------------------------------------------
+//   Write thread
+// ------------------------------------------------------------------------------
+void
+Frame_Log::
+write_thread()
+{
+	Frame_Log_Record record;
+	uint64_t since_sync = 0;
+	while (queue.pop(record)) {
+		uint64_t n = header->count;
+		records[n % header->capacity] = record;
+		// 记录写完后再增加计数，读取方按count判断哪些记录有效
+		__atomic_store_n(&header->count, n + 1, __ATOMIC_RELEASE);
+		written++;
+
+		// 数据由内核回写，这里只定期发起异步回写，断电时最多丢失最近几秒
+		if (++since_sync >= 64) {
+			msync(header, map_size, MS_ASYNC);
+			since_sync = 0;
+		}
+	}
+}
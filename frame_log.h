@@ -0,0 +1,141 @@
+/**
+ * @file frame_log.h
+ *
+ * @brief Binary per-frame log in a memory mapped ring file
+ *
+ * One fixed-size record per processed frame (mission flags, local position,
+ * per-stage timestamps, the latest setpoint latency and the target, T and F
+ * lists). The file is a header followed by `capacity` record slots; record
+ * n is stored in slot n % capacity, so the file never grows and always holds
+ * the newest records. The vision sink only
+ * copies the record into a queue; a background thread writes it into the
+ * mapping. A log with the same layout is continued after a restart.
+ *
+ * This header only depends on the C/C++ standard library so that the
+ * decoder in tools/ can be built without OpenCV or MAVLink.
+ *
+ */
+
+#ifndef FRAME_LOG_H_
+#define FRAME_LOG_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <thread>
+#include <atomic>
+
+#include "spsc_queue.h"
+
+#define FRAME_LOG_MAGIC 0x474f4c46              // "FLOG"
+#define FRAME_LOG_VERSION 4
+#define FRAME_LOG_MAX_TARGETS 24
+
+// Frame_Log_Target.kind
+enum {
+	FRAME_LOG_TARGET = 0,                       // target_ellipse_position
+	FRAME_LOG_T,                                // ellipse_T
+	FRAME_LOG_F                                 // ellipse_F
+};
+
+// Frame_Log_Record.flags
+enum {
+	FRAME_LOG_LOCAL_POSITION = 1,               // getlocalposition
+	FRAME_LOG_STABLE = 2,
+	FRAME_LOG_DROP = 4,
+	FRAME_LOG_UPDATE_ELLIPSE = 8
+};
+
+struct Frame_Log_Header
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t record_size;
+	uint32_t capacity;
+	uint64_t count;                             // 已写入的记录总数
+	uint64_t start_usec;                        // 日志创建时间(系统时钟)
+	uint8_t reserved[32];
+};
+
+struct Frame_Log_Target
+{
+	float locx;
+	float locy;
+	float possible;
+	float logodds;
+	int32_t lat;                                // 度 * 1E7
+	int32_t lon;
+	uint16_t T_N;                               // 超过65535时截断
+	uint16_t F_N;
+	int8_t kind;
+	int8_t state;                               // 目标跟踪状态：0暂定，1确认(与TRACK_TENTATIVE、TRACK_CONFIRMED相同)
+	uint16_t num;                               // 目标编号(target::num)，只增不重复使用
+};
+
+struct Frame_Log_Record
+{
+	uint64_t frame_id;
+	uint64_t stamp_us;                          // 采集时刻(单调时钟)
+	uint64_t time_usec;                         // 输出时刻(系统时钟)
+	uint64_t setpoint_frame_id;                 // 最近一次视觉驱动的local设定点依据的帧
+	uint32_t setpoint_latency_us;               // 该帧采集到设定点发出
+	// 各阶段完成时刻，相对采集时刻(us)，0为未经过该阶段
+	uint32_t preprocess_us;
+	uint32_t detect_us;
+	uint32_t classify_us;
+	uint32_t update_us;                         // 目标列表更新完成
+	uint32_t sink_us;
+	float local_x;
+	float local_y;
+	float local_z;
+	int16_t target_num;
+	uint8_t flags;
+	uint8_t n_targets;                          // targets[]中有效的个数
+	uint16_t n_total[3];                        // 各列表的实际长度，可能超过数组；目标列表不计已删除的目标
+	uint16_t reserved;
+	Frame_Log_Target targets[FRAME_LOG_MAX_TARGETS];
+};
+
+static_assert(sizeof(Frame_Log_Header) == 64, "Frame_Log_Header layout");
+static_assert(sizeof(Frame_Log_Target) == 32, "Frame_Log_Target layout");
+static_assert(sizeof(Frame_Log_Record) == 80 + 32 * FRAME_LOG_MAX_TARGETS, "Frame_Log_Record layout");
+
+// ------------------------------------------------------------------------------
+//   Writer
+// ------------------------------------------------------------------------------
+class Frame_Log
+{
+public:
+
+	explicit Frame_Log(size_t queue_len = 256);
+	~Frame_Log();
+
+	// 打开或创建日志文件，已有的同格式日志接着写
+	bool open(const char *file, uint32_t capacity);
+
+	void start();
+	// 写完已入队的记录后解除映射
+	void stop();
+
+	// 只由一个线程调用；队列满时丢弃并返回false
+	bool append(const Frame_Log_Record &record);
+
+	uint64_t get_written() const { return written; }
+	uint64_t get_dropped() const { return dropped; }
+
+private:
+
+	void write_thread();
+
+	int fd;
+	Frame_Log_Header *header;
+	Frame_Log_Record *records;
+	size_t map_size;
+
+	SPSC_Queue<Frame_Log_Record> queue;
+	std::atomic<uint64_t> written;
+	std::atomic<uint64_t> dropped;
+
+	std::thread thread_write;
+};
+
+#endif // FRAME_LOG_H_
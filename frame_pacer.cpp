@@ -0,0 +1,111 @@
+/**
+ * @file frame_pacer.cpp
+ *
+ * @brief Frame pacing for the capture stage
+ *
+ */
+
+#include "frame_pacer.h"
+
+#include <chrono>
+
+// ------------------------------------------------------------------------------
+//   Con/De structors
+// ------------------------------------------------------------------------------
+Frame_Pacer::
+Frame_Pacer(double fps) :
+	stopped(false), period_us(0), next_us(0), due_us(0), start_us(0), frames(0), idle_us(0)
+{
+	set_rate(fps);
+}
+
+void
+Frame_Pacer::
+set_rate(double fps)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	period_us = fps > 0 ? uint64_t(1e6 / fps) : 0;
+	next_us = 0;
+}
+
+// ------------------------------------------------------------------------------
+//   Pacing
+// ------------------------------------------------------------------------------
+bool
+Frame_Pacer::
+wait_next()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	uint64_t now = get_monotonic_usec();
+	if (start_us == 0)
+		start_us = now;
+	if (period_us == 0 || next_us == 0) {
+		next_us = now + period_us;
+		due_us = now;
+		return !stopped;
+	}
+
+	// 按剩余时间换算，不假定steady_clock的起点与get_monotonic_usec相同
+	if (next_us > now) {
+		std::chrono::steady_clock::time_point deadline =
+			std::chrono::steady_clock::now() + std::chrono::microseconds(next_us - now);
+		cond.wait_until(lock, deadline, [this] { return stopped; });
+	}
+	due_us = next_us;
+
+	// 处理慢于目标帧率时不累积欠账，从当前时刻重新计时
+	now = get_monotonic_usec();
+	next_us = next_us + period_us > now ? next_us + period_us : now + period_us;
+	return !stopped;
+}
+
+void
+Frame_Pacer::
+frame_done(uint64_t wait_start_us)
+{
+	uint64_t now = get_monotonic_usec();
+	idle_us += now - wait_start_us;
+	frames++;
+
+	// 到时刻时还没有新帧，取帧又等了相机(超过1/10周期，不算调度抖动)：从取到帧的时刻重新计时，
+	// 下一个时刻落在下一帧到达之后，不再每帧先等时刻再等相机
+	std::lock_guard<std::mutex> lock(mutex);
+	if (period_us && now > due_us + period_us / 10 && next_us < now + period_us)
+		next_us = now + period_us;
+}
+
+void
+Frame_Pacer::
+stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopped = true;
+	}
+	cond.notify_all();
+}
+
+// ------------------------------------------------------------------------------
+//   Stats
+// ------------------------------------------------------------------------------
+double
+Frame_Pacer::
+get_fps() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	if (start_us == 0)
+		return 0.;
+	uint64_t wall = get_monotonic_usec() - start_us;
+	return wall ? frames * 1e6 / wall : 0.;
+}
+
+double
+Frame_Pacer::
+get_idle() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	if (start_us == 0)
+		return 0.;
+	uint64_t wall = get_monotonic_usec() - start_us;
+	return wall ? double(idle_us) / wall : 0.;
+}
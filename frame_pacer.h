@@ -0,0 +1,62 @@
+/**
+ * @file frame_pacer.h
+ *
+ * @brief Frame pacing for the capture stage
+ *
+ * With a target rate of 0 the capture stage takes a frame as soon as the
+ * grabber publishes one (it blocks on the grabber's condition variable, no
+ * polling). With a target rate the pacer additionally holds the capture
+ * stage until the next frame slot and takes the freshest frame published by
+ * then; frames arriving meanwhile are overwritten in the grabber. Only when
+ * nothing arrived since the previous frame does the stage go on to wait for
+ * the camera, and the schedule then restarts from that frame, so the next
+ * slot falls after the next camera frame instead of paying both waits again.
+ * Both waits are counted as idle time, so the report shows how much head
+ * room the pipeline has at the achieved frame rate.
+ *
+ */
+
+#ifndef FRAME_PACER_H_
+#define FRAME_PACER_H_
+
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+#include "autopilot_interface.h"
+
+class Frame_Pacer
+{
+public:
+
+	// fps: 目标帧率，0为跟随相机
+	explicit Frame_Pacer(double fps = 0);
+
+	void set_rate(double fps);
+
+	// 等到下一帧的时刻，stop()之后返回false
+	bool wait_next();
+
+	// 一帧已取到，wait_start_us为开始等待(wait_next之前)的时刻；取帧晚于时刻时从现在重新计时
+	void frame_done(uint64_t wait_start_us);
+
+	void stop();
+
+	double get_fps() const;
+	double get_idle() const;                // 等待(相机或目标帧率)时间占比
+
+private:
+
+	mutable std::mutex mutex;
+	std::condition_variable cond;
+	bool stopped;
+
+	uint64_t period_us;
+	uint64_t next_us;
+	uint64_t due_us;                        // 本帧的时刻
+	uint64_t start_us;
+	std::atomic<uint64_t> frames;
+	std::atomic<uint64_t> idle_us;
+};
+
+#endif // FRAME_PACER_H_
@@ -0,0 +1,479 @@
+/**
+ * @file frame_source.cpp
+ *
+ * @brief Frame sources for the vision pipeline
+ *
+ */
+
+#include "frame_source.h"
+
+#include <string.h>
+#include <strings.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// ------------------------------------------------------------------------------
+//   Camera
+// ------------------------------------------------------------------------------
+Camera_Source::
+Camera_Source(int device_, Size size_) :
+	device(device_)
+{
+	// 优先使用V4L2后端，不可用时由OpenCV自行选择
+	if (!cap.open(device + CAP_V4L2))
+		cap.open(device);
+	if (!cap.isOpened())
+		return;
+	cap.set(CV_CAP_PROP_FRAME_WIDTH, size_.width);
+	cap.set(CV_CAP_PROP_FRAME_HEIGHT, size_.height);
+	cap.set(CAP_PROP_AUTOFOCUS, 0);
+}
+
+Size
+Camera_Source::
+size() const
+{
+	return Size(cvRound(cap.get(CV_CAP_PROP_FRAME_WIDTH)), cvRound(cap.get(CV_CAP_PROP_FRAME_HEIGHT)));
+}
+
+double
+Camera_Source::
+fps() const
+{
+	return cap.get(CV_CAP_PROP_FPS);
+}
+
+string
+Camera_Source::
+name() const
+{
+	return "camera:" + to_string(device);
+}
+
+// ------------------------------------------------------------------------------
+//   Video file
+// ------------------------------------------------------------------------------
+Video_File_Source::
+Video_File_Source(const string &file_) :
+	file(file_)
+{
+	cap.open(file);
+}
+
+Size
+Video_File_Source::
+size() const
+{
+	return Size(cvRound(cap.get(CV_CAP_PROP_FRAME_WIDTH)), cvRound(cap.get(CV_CAP_PROP_FRAME_HEIGHT)));
+}
+
+double
+Video_File_Source::
+fps() const
+{
+	return cap.get(CV_CAP_PROP_FPS);
+}
+
+// ------------------------------------------------------------------------------
+//   Raw file
+// ------------------------------------------------------------------------------
+Raw_File_Source::
+Raw_File_Source(const string &file_) :
+	file(file_), fd(-1), map(NULL), map_size(0), header(NULL), next(0)
+{
+	fd = open(file.c_str(), O_RDONLY);
+	if (fd < 0)
+		return;
+	struct stat st;
+	if (fstat(fd, &st) != 0 || size_t(st.st_size) < RAW_FRAMES_PAGE)
+		return;
+	map_size = st.st_size;
+	void *p = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	if (p == MAP_FAILED)
+		return;
+	map = (uint8_t *)p;
+	madvise(map, map_size, MADV_SEQUENTIAL);
+
+	const Raw_Frames_Header *h = (const Raw_Frames_Header *)map;
+	size_t frame_bytes = size_t(h->width) * h->height * 3;
+	if (h->magic != RAW_FRAMES_MAGIC || h->frame_stride < frame_bytes || h->frame_stride % RAW_FRAMES_PAGE ||
+	    RAW_FRAMES_PAGE + size_t(h->count) * h->frame_stride > map_size) {
+		printf("WARNING: %s is not a raw frame file\n", file.c_str());
+		return;
+	}
+	if (h->version != 2) {
+		printf("WARNING: %s is a version %u raw frame file, convert the video again with --to-raw\n",
+		       file.c_str(), h->version);
+		return;
+	}
+	header = h;
+}
+
+Raw_File_Source::
+~Raw_File_Source()
+{
+	if (map)
+		munmap(map, map_size);
+	if (fd >= 0)
+		close(fd);
+}
+
+bool
+Raw_File_Source::
+read(Mat3b &image)
+{
+	if (!header || next >= header->count)
+		return false;
+	uint8_t *frame = map + RAW_FRAMES_PAGE + size_t(next) * header->frame_stride;
+	image = Mat3b(header->height, header->width, (Vec3b *)frame);
+	next++;
+	return true;
+}
+
+Size
+Raw_File_Source::
+size() const
+{
+	return header ? Size(header->width, header->height) : Size();
+}
+
+double
+Raw_File_Source::
+fps() const
+{
+	return header ? header->fps : 0.;
+}
+
+// ------------------------------------------------------------------------------
+//   MJPEG
+// ------------------------------------------------------------------------------
+static uint32_t
+read_le32(const uint8_t *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | (uint32_t(p[3]) << 24);
+}
+
+// SOF段中的图像尺寸
+static bool
+jpeg_size(const uint8_t *p, size_t bytes, Size &size)
+{
+	size_t i = 2;
+	while (i + 9 <= bytes) {
+		if (p[i] != 0xFF)
+			return false;
+		uint8_t marker = p[i + 1];
+		if (marker == 0xFF) {
+			i++;
+			continue;
+		}
+		if (marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC) {
+			size = Size((p[i + 7] << 8) | p[i + 8], (p[i + 5] << 8) | p[i + 6]);
+			return size.area() > 0;
+		}
+		if (marker == 0xDA)
+			return false;
+		i += 2 + ((p[i + 2] << 8) | p[i + 3]);
+	}
+	return false;
+}
+
+// 从SOI开始按段解析，返回EOI之后的位置，不完整时返回0
+// 熵编码数据中0xFF只会跟0x00(填充)或RST0~7，其他组合为下一个标记；
+// 逐段跳过而不是直接查找FFD9，APP段中的缩略图不会被当作帧的结尾
+static size_t
+jpeg_end(const uint8_t *p, size_t begin, size_t end)
+{
+	size_t i = begin + 2;
+	while (i + 2 <= end) {
+		if (p[i] != 0xFF)
+			return 0;
+		uint8_t marker = p[i + 1];
+		if (marker == 0xFF) {
+			i++;
+			continue;
+		}
+		if (marker == 0xD9)
+			return i + 2;
+		if ((marker >= 0xD0 && marker <= 0xD7) || marker == 0x01) {
+			i += 2;
+			continue;
+		}
+		if (i + 4 > end)
+			return 0;
+		i += 2 + ((p[i + 2] << 8) | p[i + 3]);
+		if (marker != 0xDA)
+			continue;
+		while (i + 1 < end && !(p[i] == 0xFF && p[i + 1] != 0x00 && !(p[i + 1] >= 0xD0 && p[i + 1] <= 0xD7)))
+			i++;
+	}
+	return 0;
+}
+
+Mjpeg_Source::
+Mjpeg_Source(const string &file_, int scale_, int min_width) :
+	file(file_), fd(-1), map(NULL), map_size(0), next(0), avi(false), scale(1), frame_rate(0)
+{
+	fd = open(file.c_str(), O_RDONLY);
+	if (fd < 0)
+		return;
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size < 12)
+		return;
+	map_size = st.st_size;
+	void *p = mmap(NULL, map_size, PROT_READ, MAP_SHARED, fd, 0);
+	if (p == MAP_FAILED)
+		return;
+	map = (uint8_t *)p;
+	madvise(map, map_size, MADV_SEQUENTIAL);
+
+	if (memcmp(map, "RIFF", 4) == 0 && memcmp(map + 8, "AVI ", 4) == 0) {
+		avi = true;
+		// OpenDML: 1GB之后的数据在后续的RIFF AVIX块中
+		size_t pos = 0;
+		while (pos + 12 <= map_size && memcmp(map + pos, "RIFF", 4) == 0) {
+			size_t end = min(pos + 8 + read_le32(map + pos + 4), map_size);
+			index_avi(pos + 12, end);
+			pos = end + (end & 1);
+		}
+	} else
+		index_concatenated();
+
+	if (frames.empty() || !jpeg_size(map + frames[0].offset, frames[0].bytes, full_size)) {
+		frames.clear();
+		if (!avi)
+			printf("WARNING: %s has no JPEG frames\n", file.c_str());
+		return;
+	}
+	// 自动时取缩小后宽度仍不小于检测图宽度的最大倍数
+	scale = scale_;
+	if (scale != 1 && scale != 2 && scale != 4 && scale != 8) {
+		scale = 1;
+		for (int s = 8; s > 1; s /= 2) {
+			if (full_size.width / s >= min_width) {
+				scale = s;
+				break;
+			}
+		}
+	}
+}
+
+Mjpeg_Source::
+~Mjpeg_Source()
+{
+	if (map)
+		munmap(map, map_size);
+	if (fd >= 0)
+		close(fd);
+}
+
+void
+Mjpeg_Source::
+index_avi(size_t begin, size_t end)
+{
+	size_t pos = begin;
+	while (pos + 8 <= end) {
+		const uint8_t *chunk = map + pos;
+		size_t bytes = read_le32(chunk + 4);
+		size_t data = pos + 8;
+		if (data + bytes > end)
+			bytes = end - data;
+		if (memcmp(chunk, "LIST", 4) == 0 && bytes >= 4) {
+			// hdrl/strl中有帧间隔，movi(及其中的rec)中是各帧
+			if (memcmp(chunk + 8, "hdrl", 4) == 0 || memcmp(chunk + 8, "movi", 4) == 0 ||
+			    memcmp(chunk + 8, "rec ", 4) == 0)
+				index_avi(data + 4, data + bytes);
+		} else if (memcmp(chunk, "avih", 4) == 0 && bytes >= 4) {
+			uint32_t us = read_le32(map + data);
+			if (us)
+				frame_rate = 1e6 / us;
+		} else if ((memcmp(chunk + 2, "dc", 2) == 0 || memcmp(chunk + 2, "db", 2) == 0) &&
+		           bytes > 4 && map[data] == 0xFF && map[data + 1] == 0xD8) {
+			Jpeg_Frame frame = { data, bytes };
+			frames.push_back(frame);
+		}
+		pos = data + bytes + (bytes & 1);
+	}
+}
+
+void
+Mjpeg_Source::
+index_concatenated()
+{
+	// 帧之间允许有其他数据(如HTTP multipart的分隔行)
+	size_t pos = 0;
+	while (pos + 4 <= map_size) {
+		const uint8_t *soi = (const uint8_t *)memchr(map + pos, 0xFF, map_size - pos - 3);
+		if (soi == NULL)
+			break;
+		pos = soi - map;
+		if (soi[1] != 0xD8 || soi[2] != 0xFF) {
+			pos++;
+			continue;
+		}
+		size_t end = jpeg_end(map, pos, map_size);
+		if (end == 0)
+			break;
+		Jpeg_Frame frame = { pos, end - pos };
+		frames.push_back(frame);
+		pos = end;
+	}
+}
+
+bool
+Mjpeg_Source::
+decode(size_t n, Mat3b &image)
+{
+	static const int flags[9] = { IMREAD_COLOR, IMREAD_COLOR, IMREAD_REDUCED_COLOR_2, IMREAD_COLOR,
+	                              IMREAD_REDUCED_COLOR_4, IMREAD_COLOR, IMREAD_COLOR, IMREAD_COLOR,
+	                              IMREAD_REDUCED_COLOR_8 };
+	// 直接从映射内存解码，尺寸不变时复用image的缓冲区
+	Mat buf(1, int(frames[n].bytes), CV_8U, map + frames[n].offset);
+	imdecode(buf, flags[scale], &image);
+	return !image.empty();
+}
+
+bool
+Mjpeg_Source::
+read(Mat3b &image)
+{
+	// 损坏的帧跳过
+	while (next < frames.size()) {
+		if (decode(next++, image))
+			return true;
+	}
+	return false;
+}
+
+bool
+Mjpeg_Source::
+read(Mat3b &image, Mat1b &encoded)
+{
+	if (!read(image))
+		return false;
+	// 只是映射内存上的Mat头，全分辨率解码时才读取
+	const Jpeg_Frame &frame = frames[next - 1];
+	encoded = Mat1b(1, int(frame.bytes), map + frame.offset);
+	return true;
+}
+
+bool
+decode_full_frame(const Mat1b &encoded, Mat3b &image)
+{
+	if (encoded.empty())
+		return false;
+	imdecode(encoded, IMREAD_COLOR, &image);
+	return !image.empty();
+}
+
+// ------------------------------------------------------------------------------
+//   Factory
+// ------------------------------------------------------------------------------
+static bool
+has_suffix(const string &s, const char *suffix)
+{
+	size_t n = strlen(suffix);
+	return s.size() > n && strcasecmp(s.c_str() + s.size() - n, suffix) == 0;
+}
+
+Frame_Source *
+open_frame_source(const string &spec, int decode_scale)
+{
+	Frame_Source *source = NULL;
+	bool ok = false;
+	bool number = !spec.empty() && spec.find_first_not_of("0123456789") == string::npos;
+	if (spec.compare(0, 7, "camera:") == 0 || number) {
+		Camera_Source *camera = new Camera_Source(atoi(spec.c_str() + (number ? 0 : 7)));
+		ok = camera->is_open();
+		source = camera;
+	} else if (has_suffix(spec, ".raw")) {
+		Raw_File_Source *raw = new Raw_File_Source(spec);
+		ok = raw->is_open();
+		source = raw;
+	} else if (has_suffix(spec, ".mjpg") || has_suffix(spec, ".mjpeg")) {
+		Mjpeg_Source *mjpeg = new Mjpeg_Source(spec, decode_scale);
+		ok = mjpeg->is_open();
+		source = mjpeg;
+	}
+	if (source == NULL && decode_scale != 1 && has_suffix(spec, ".avi")) {
+		// MJPEG AVI按缩小比例解码，其他编码或不需缩小时仍由VideoCapture读取
+		Mjpeg_Source *mjpeg = new Mjpeg_Source(spec, decode_scale);
+		if (mjpeg->is_open() && mjpeg->decode_scale() > 1) {
+			ok = true;
+			source = mjpeg;
+		} else
+			delete mjpeg;
+	}
+	if (source == NULL) {
+		Video_File_Source *video = new Video_File_Source(spec);
+		ok = video->is_open();
+		source = video;
+	}
+	if (!ok) {
+		printf("WARNING: could not open frame source %s\n", spec.c_str());
+		delete source;
+		return NULL;
+	}
+	return source;
+}
+
+// ------------------------------------------------------------------------------
+//   Conversion
+// ------------------------------------------------------------------------------
+int
+ConvertToRawFrames(const char *video, const char *raw)
+{
+	Video_File_Source source(video);
+	if (!source.is_open()) {
+		printf("could not open %s\n", video);
+		return 1;
+	}
+	FILE *fp = fopen(raw, "wb");
+	if (fp == NULL) {
+		printf("could not create %s\n", raw);
+		return 1;
+	}
+	Raw_Frames_Header header;
+	memset(&header, 0, sizeof(header));
+	header.magic = RAW_FRAMES_MAGIC;
+	header.version = 2;
+	vector<uint8_t> pad(RAW_FRAMES_PAGE - sizeof(header), 0);
+	fwrite(&header, sizeof(header), 1, fp);
+	fwrite(pad.data(), 1, pad.size(), fp);
+
+	Mat3b image;
+	uint32_t count = 0;
+	while (source.read(image) && !image.empty()) {
+		if (count == 0) {
+			header.width = image.cols;
+			header.height = image.rows;
+			// 帧距按页对齐，每帧的像素从页边界开始
+			size_t bytes = size_t(image.cols) * image.rows * 3;
+			header.frame_stride = uint32_t((bytes + RAW_FRAMES_PAGE - 1) & ~size_t(RAW_FRAMES_PAGE - 1));
+			pad.assign(header.frame_stride - bytes, 0);
+		} else if (image.cols != int(header.width) || image.rows != int(header.height)) {
+			printf("frame %u size changed, stopping\n", count);
+			break;
+		}
+		for (int r = 0; r < image.rows; r++)
+			fwrite(image.ptr(r), 1, image.cols * 3, fp);
+		fwrite(pad.data(), 1, pad.size(), fp);
+		count++;
+	}
+	header.count = count;
+	header.fps = source.fps();
+	fseek(fp, 0, SEEK_SET);
+	fwrite(&header, sizeof(header), 1, fp);
+	fclose(fp);
+
+	// 录像索引原样复制，回放时按<raw>.idx对齐遥测
+	ifstream idx_in((string(video) + ".idx").c_str(), ios::binary);
+	if (idx_in) {
+		ofstream idx_out((string(raw) + ".idx").c_str(), ios::binary);
+		idx_out << idx_in.rdbuf();
+	}
+	printf("%s: %u frames %ux%u, %.1f MB\n", raw, count, header.width, header.height,
+	       (RAW_FRAMES_PAGE + double(count) * header.frame_stride) / 1e6);
+	return 0;
+}
@@ -0,0 +1,200 @@
+/**
+ * @file frame_source.h
+ *
+ * @brief Frame sources for the vision pipeline
+ *
+ * Frame_Source hides where the frames come from:
+ *  - Camera_Source: V4L2 camera through VideoCapture (1920x1080, autofocus off)
+ *  - Video_File_Source: any file VideoCapture can decode
+ *  - Raw_File_Source: uncompressed BGR frames in a memory mapped file; read()
+ *    returns a Mat header over the mapped pages, so nothing is decoded or
+ *    copied and replays/benchmarks are limited by the detector, not by the
+ *    decoder. Convert a recording with --to-raw <video> <file.raw>.
+ *  - Mjpeg_Source: JPEG frames of an MJPEG AVI or of a file of concatenated
+ *    JPEGs (.mjpg). The detection image is decoded with libjpeg DCT scaling
+ *    (1/2, 1/4, 1/8), which skips most of the IDCT and color conversion work;
+ *    the compressed frame travels with the image and is decoded at full
+ *    resolution only for frames that need high resolution ROIs.
+ *
+ * open_frame_source() picks the implementation from a spec string:
+ * "camera:<n>" (or a bare number), "*.raw", "*.mjpg"/"*.mjpeg", an MJPEG AVI
+ * that can be decoded reduced (automatic by default, so replays of the raw
+ * recordings use it), otherwise a video file. The camera still goes through
+ * VideoCapture, which only hands out decoded frames.
+ *
+ */
+
+#ifndef FRAME_SOURCE_H_
+#define FRAME_SOURCE_H_
+
+#include <string>
+
+#include "autopilot_interface.h"
+
+class Frame_Source
+{
+public:
+
+	virtual ~Frame_Source() {}
+
+	// 读下一帧，返回false表示结束；image可能指向源内部的内存，下一次read之前有效
+	virtual bool read(Mat3b &image) = 0;
+
+	// 压缩帧源：image按decode_scale()缩小解码，encoded为这一帧的JPEG数据(映射内存上的Mat头，
+	// 不拷贝，帧源存在期间有效)，需要全分辨率时用decode_full_frame()解码；其他帧源encoded为空
+	virtual bool read(Mat3b &image, Mat1b &encoded) { encoded.release(); return read(image); }
+	// image相对size()的缩小倍数
+	virtual int decode_scale() const { return 1; }
+
+	virtual Size size() const = 0;
+	virtual double fps() const = 0;
+	// 回放时用于查找录像索引<name>.idx
+	virtual string name() const = 0;
+};
+
+// ------------------------------------------------------------------------------
+//   VideoCapture: camera / video file
+// ------------------------------------------------------------------------------
+class Camera_Source : public Frame_Source
+{
+public:
+
+	Camera_Source(int device, Size size_ = Size(1920, 1080));
+
+	bool is_open() const { return cap.isOpened(); }
+
+	bool read(Mat3b &image) { return cap.read(image); }
+	Size size() const;
+	double fps() const;
+	string name() const;
+
+private:
+
+	mutable VideoCapture cap;
+	int device;
+};
+
+class Video_File_Source : public Frame_Source
+{
+public:
+
+	explicit Video_File_Source(const string &file_);
+
+	bool is_open() const { return cap.isOpened(); }
+
+	bool read(Mat3b &image) { return cap.read(image); }
+	Size size() const;
+	double fps() const;
+	string name() const { return file; }
+
+private:
+
+	mutable VideoCapture cap;
+	string file;
+};
+
+// ------------------------------------------------------------------------------
+//   Memory mapped raw frames
+// ------------------------------------------------------------------------------
+#define RAW_FRAMES_MAGIC 0x57415246             // "FRAW"
+#define RAW_FRAMES_PAGE 4096
+
+// 文件头占第一页，之后每帧的像素从页边界开始，帧距为页大小的整数倍；各帧时刻在<raw>.idx中
+struct Raw_Frames_Header
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t width;
+	uint32_t height;
+	uint32_t frame_stride;                      // 相邻两帧的字节距离
+	uint32_t count;
+	double fps;
+	uint8_t reserved[32];
+};
+
+class Raw_File_Source : public Frame_Source
+{
+public:
+
+	explicit Raw_File_Source(const string &file_);
+	~Raw_File_Source();
+
+	bool is_open() const { return header != NULL; }
+
+	// 零拷贝：image为映射内存上的Mat头(写时复制映射，写入不会改动文件)
+	bool read(Mat3b &image);
+	Size size() const;
+	double fps() const;
+	string name() const { return file; }
+
+private:
+
+	string file;
+	int fd;
+	uint8_t *map;
+	size_t map_size;
+	const Raw_Frames_Header *header;
+	uint32_t next;
+};
+
+// ------------------------------------------------------------------------------
+//   MJPEG: reduced resolution decode
+// ------------------------------------------------------------------------------
+// 自动缩小时检测图宽度的下限：检测的工作分辨率一般不超过480(resolution.widths)，
+// 录像的原图(960)和相机图像(1920)因此分别按1/2、1/4解码
+#define MJPEG_MIN_WIDTH 480
+
+class Mjpeg_Source : public Frame_Source
+{
+public:
+
+	// scale: 检测图的缩小倍数1、2、4、8，0为宽度不小于min_width的最大倍数
+	Mjpeg_Source(const string &file_, int scale = 0, int min_width = MJPEG_MIN_WIDTH);
+	~Mjpeg_Source();
+
+	bool is_open() const { return !frames.empty(); }
+	// 文件为AVI且帧为JPEG
+	bool is_avi() const { return avi; }
+
+	bool read(Mat3b &image);
+	bool read(Mat3b &image, Mat1b &encoded);
+	int decode_scale() const { return scale; }
+	Size size() const { return full_size; }
+	double fps() const { return frame_rate; }
+	string name() const { return file; }
+
+private:
+
+	struct Jpeg_Frame
+	{
+		size_t offset;
+		size_t bytes;
+	};
+
+	void index_avi(size_t begin, size_t end);
+	void index_concatenated();
+	bool decode(size_t n, Mat3b &image);
+
+	string file;
+	int fd;
+	uint8_t *map;
+	size_t map_size;
+	vector<Jpeg_Frame> frames;
+	size_t next;
+	bool avi;
+	int scale;
+	Size full_size;
+	double frame_rate;
+};
+
+// 全分辨率解码JPEG数据，image的缓冲区尺寸不变时复用
+bool decode_full_frame(const Mat1b &encoded, Mat3b &image);
+
+// 根据spec打开帧源，失败返回NULL
+// decode_scale: 压缩帧源检测图的缩小倍数，0为自动，1(或自动时不能缩小)时MJPEG AVI仍由VideoCapture读取
+Frame_Source *open_frame_source(const string &spec, int decode_scale = 0);
+
+// 把录像转换为Raw_File_Source使用的文件，<video>.idx存在时复制为<raw>.idx，回放时按它对齐各帧时刻
+int ConvertToRawFrames(const char *video, const char *raw);
+
+#endif // FRAME_SOURCE_H_
@@ -0,0 +1,93 @@
+/**
+ * @file latency_histogram.cpp
+ *
+ * @brief Rolling latency histogram with percentile queries
+ *
+ */
+
+#include "latency_histogram.h"
+
+#include <stdio.h>
+#include <math.h>
+
+// ------------------------------------------------------------------------------
+//   Con/De structors
+// ------------------------------------------------------------------------------
+Latency_Histogram::
+Latency_Histogram(size_t window) :
+	counts(BUCKETS, 0), ring(window ? window : 1, 0), head(0), filled(0)
+{
+}
+
+// ------------------------------------------------------------------------------
+//   Buckets
+// ------------------------------------------------------------------------------
+int
+Latency_Histogram::
+bucket(uint64_t us)
+{
+	if (us < 100)
+		return 0;
+	int b = 1 + int(20 * log10(us / 100.));
+	return b < BUCKETS ? b : BUCKETS - 1;
+}
+
+uint64_t
+Latency_Histogram::
+upper(int b)
+{
+	return uint64_t(100 * pow(10., b / 20.));
+}
+
+// ------------------------------------------------------------------------------
+//   Samples
+// ------------------------------------------------------------------------------
+void
+Latency_Histogram::
+add(uint64_t us)
+{
+	int b = bucket(us);
+	std::lock_guard<std::mutex> lock(mutex);
+	if (filled == ring.size())
+		counts[ring[head]]--;
+	else
+		filled++;
+	ring[head] = uint16_t(b);
+	counts[b]++;
+	head = (head + 1) % ring.size();
+}
+
+uint64_t
+Latency_Histogram::
+percentile(double p) const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	if (filled == 0)
+		return 0;
+	uint64_t rank = uint64_t(ceil(p / 100. * filled));
+	if (rank == 0)
+		rank = 1;
+	uint64_t seen = 0;
+	for (int b = 0; b < BUCKETS; b++) {
+		seen += counts[b];
+		if (seen >= rank)
+			return upper(b);
+	}
+	return upper(BUCKETS - 1);
+}
+
+size_t
+Latency_Histogram::
+count() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return filled;
+}
+
+void
+Latency_Histogram::
+format(char *buf, size_t len) const
+{
+	snprintf(buf, len, "p50 = %.1f p95 = %.1f p99 = %.1f ms (n = %u)",
+	         percentile(50) / 1000., percentile(95) / 1000., percentile(99) / 1000., (unsigned)count());
+}
@@ -0,0 +1,51 @@
+/**
+ * @file latency_histogram.h
+ *
+ * @brief Rolling latency histogram with percentile queries
+ *
+ * Log-spaced buckets from 100 us to 100 s (20 per decade, about 12% wide).
+ * Only the last `window` samples are counted: each new sample evicts the
+ * oldest one from its bucket, so add() is O(1) and a percentile query walks
+ * the buckets once. Percentiles are reported as the upper edge of the
+ * bucket they fall into.
+ *
+ */
+
+#ifndef LATENCY_HISTOGRAM_H_
+#define LATENCY_HISTOGRAM_H_
+
+#include <stdint.h>
+#include <vector>
+#include <mutex>
+
+class Latency_Histogram
+{
+public:
+
+	explicit Latency_Histogram(size_t window = 1000);
+
+	void add(uint64_t us);
+
+	// p: 0~100，没有样本时返回0
+	uint64_t percentile(double p) const;
+
+	size_t count() const;
+
+	// "p50 = 12.3 p95 = 20.1 p99 = 35.0 ms (n = 1000)"
+	void format(char *buf, size_t len) const;
+
+private:
+
+	static int bucket(uint64_t us);
+	static uint64_t upper(int b);
+
+	static const int BUCKETS = 20 * 6 + 1;      // 100us~100s，外加一个<100us
+
+	mutable std::mutex mutex;
+	std::vector<uint32_t> counts;
+	std::vector<uint16_t> ring;                 // 窗口内样本的桶号
+	size_t head;
+	size_t filled;
+};
+
+#endif // LATENCY_HISTOGRAM_H_
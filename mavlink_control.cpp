@@ -21,6 +21,11 @@
 #include <cv.h>
 #include "ellipse/EllipseDetectorYaed.h"
 #include "autopilot_interface.h"
+#include "ellipse/CandidateFilterChain.h"
+#include "ellipse/TFRecognizer.h"
+#include "vision_pipeline.h"
+#include "replay.h"
+#include "frame_source.h"
 #include <thread>//多线程
 #include <fstream>
 #include <cmath>
@@ -29,6 +34,13 @@ using namespace cv;
 using namespace std;
 
 vector<target> target_ellipse_position, ellipse_T, ellipse_F;
+Target_Grid target_grid(5);
+Target_Tracker target_tracker;
+
+// --replay时视觉线程读录像而不是相机
+static Replay_Options replay_options;
+// 视觉流水线上次运行的帧率(输出阶段的帧数 / 运行时间)，回放结束时输出
+static double vision_fps = 0;
 
 
 // ------------------------------------------------------------------------------
@@ -53,6 +65,77 @@ top (int argc, char **argv)
 #endif
     int baudrate = 57600;
 
+    // 离线训练T/F分类器，不连接飞控
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--train-tf") == 0) {
+            if (argc > i + 2)
+                return TrainTFClassifier(argv[i + 1], argv[i + 2]);
+            printf("usage: mavlink_serial --train-tf <sample list> <model.yml>\n");
+            throw EXIT_FAILURE;
+        }
+    }
+
+    // 从录像导出ROI，标注后作为--train-tf的样本
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--dump-rois") == 0) {
+            if (argc > i + 2)
+                return DumpRois(argv[i + 1], argv[i + 2], argc > i + 3 ? atoi(argv[i + 3]) : 10);
+            printf("usage: mavlink_serial --dump-rois <video> <dir> [every n frames]\n");
+            throw EXIT_FAILURE;
+        }
+    }
+
+    // 目标关联的基准测试，不连接飞控和相机
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--bench-targets") == 0)
+            return BenchTargetGrid(argc > i + 1 ? atoi(argv[i + 1]) : 0);
+    }
+
+    // T/F识别的基准测试：按录像逐帧检测和识别，输出墙钟ROI/s和内存
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--bench-rec") == 0) {
+            if (argc > i + 1)
+                return BenchRecognition(argv[i + 1], argc > i + 2 ? atof(argv[i + 2]) : 30.);
+            printf("usage: mavlink_serial --bench-rec <video> [minutes]\n");
+            throw EXIT_FAILURE;
+        }
+    }
+
+    // 录像转换为可直接映射的原始帧文件
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--to-raw") == 0) {
+            if (argc > i + 2)
+                return ConvertToRawFrames(argv[i + 1], argv[i + 2]);
+            printf("usage: mavlink_serial --to-raw <video> <frames.raw>\n");
+            throw EXIT_FAILURE;
+        }
+    }
+
+    // 离线回放录像和遥测日志，不连接飞控和相机
+    const char *tlog_file = NULL;
+    bool replay_fast = false;
+    double replay_speed = 1.0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--replay") == 0) {
+            if (argc <= i + 2) {
+                printf("usage: mavlink_serial --replay <video> <telemetry.tlog> [--wl <wl.tlog>] [--fast] [--speed x]\n");
+                throw EXIT_FAILURE;
+            }
+            replay_options.video = argv[i + 1];
+            replay_options.tlog = argv[i + 2];
+        }
+        if (strcmp(argv[i], "--wl") == 0 && argc > i + 1)
+            replay_options.wl_tlog = argv[i + 1];
+        if (strcmp(argv[i], "--fast") == 0)
+            replay_fast = true;
+        if (strcmp(argv[i], "--speed") == 0 && argc > i + 1)
+            replay_speed = atof(argv[i + 1]);
+        if (strcmp(argv[i], "--tlog") == 0 && argc > i + 1)
+            tlog_file = argv[i + 1];
+    }
+    if (!replay_options.video.empty())
+        return replay(replay_fast, replay_speed);
+
     // do the parse, will throw an int if it fails
     parse_commandline(argc, argv, uart_name, baudrate);
     parse_commandline(argc, argv, WL_uart, baudrate);
@@ -74,6 +157,8 @@ top (int argc, char **argv)
      */
     Serial_Port serial_port(uart_name, baudrate);
     Serial_Port WL_serial_port(WL_uart,baudrate);
+    if (tlog_file)
+        serial_port.record_tlog(tlog_file);  // 飞控遥测记录下来供--replay使用
 
 
     /*
@@ -149,10 +234,83 @@ top (int argc, char **argv)
 }
 
 
+// ------------------------------------------------------------------------------
+//   REPLAY
+// ------------------------------------------------------------------------------
+/*
+ * 用录像和遥测日志代替相机和串口运行同一套程序：
+ * 飞控链路读tlog，机间链路读--wl指定的tlog(没有时保持空闲)，视觉线程读录像。
+ * 有机间链路日志时运行完整的任务流程commands()，否则只运行videothread，
+ * 视频结束后输出吞吐量和设定点延迟。
+ */
+int
+replay(bool fast, double speed)
+{
+    Replay_Clock clock;
+    clock.configure(fast, speed);
+    replay_options.clock = &clock;
+    set_decision_clock(&clock);
+
+    Serial_Port serial_port(replay_options.tlog.c_str(), 0);
+    Serial_Port WL_serial_port(replay_options.wl_tlog.c_str(), 0);
+    serial_port.set_replay(&clock);
+    WL_serial_port.set_replay(&clock);
+
+    Autopilot_Interface autopilot_interface(&serial_port, &WL_serial_port);
+    serial_port_quit         = &serial_port;
+    autopilot_interface_quit = &autopilot_interface;
+    signal(SIGINT,quit_handler);
+
+    serial_port.start();
+    WL_serial_port.start();
+    uint64_t t0 = get_monotonic_usec();
+    autopilot_interface.start();
+
+    if (replay_options.wl_tlog.empty())
+        videothread(autopilot_interface);
+    else
+        commands(autopilot_interface);
+
+    double wall_s = (get_monotonic_usec() - t0) / 1e6;
+    uint64_t log_first = tlog_first_usec(replay_options.tlog.c_str());
+    char buf[96];
+    autopilot_interface.setpoint_latency.format(buf, sizeof(buf));
+    printf("replay %s: %.1f s wall, %.1f s log, telemetry messages = %llu, setpoints written = %llu\n",
+           fast ? "fast" : "real time", wall_s, ((double)clock.now() - log_first) / 1e6,
+           (unsigned long long)serial_port.replay_messages, (unsigned long long)serial_port.replay_writes);
+    printf("replay capture->setpoint %s\n", buf);
+    printf("replay vision pipeline fps = %.1f\n", vision_fps);
+    // 各目标在日志中的判定时刻，与飞行记录或人工标注对比
+    vector<TF_Decision> decisions = tf_decisions();
+    if (decisions.empty())
+        printf("replay decisions: none\n");
+    for (size_t i = 0; i < decisions.size(); i++)
+        printf("replay decision: target %d = %s at %.2f s log\n", decisions[i].num, decisions[i].T ? "T" : "F",
+               ((double)decisions[i].time_us - log_first) / 1e6);
+
+    clock.stop();
+    autopilot_interface.stop();
+    serial_port.stop();
+    WL_serial_port.stop();
+    set_decision_clock(NULL);
+    return 0;
+}
+
+
 // ------------------------------------------------------------------------------
 //   COMMANDS
 // ------------------------------------------------------------------------------
 
+// 目标相对飞机的偏差(像素)，目标列表由识别融合阶段更新，在target_mutex内取拷贝
+static void
+target_offset(int num, float &x, float &y)
+{
+    target t;
+    get_target(num, t);
+    x = t.x;
+    y = t.y;
+}
+
 void
 commands(Autopilot_Interface &api)
 {
@@ -161,7 +319,7 @@ commands(Autopilot_Interface &api)
     float dist, distance, XYdis;
     bool flag = true;
     bool detect = false;
-    TargetNum = 0;
+    TargetNum = -1;
     int TNum = 0;
     stable = false;
     updateellipse = false;
@@ -266,17 +424,22 @@ commands(Autopilot_Interface &api)
             //停止添加圆,然后开始识别字符
             updateellipse = true;
 
-            while(target_ellipse_position.size() > TargetNum)
+            //每次取离飞机最近且未访问过的目标，按编号引用，目标列表不再排序
+            vector<bool> visited;
+            while((TargetNum = next_target(api, target_ellipse_position, visited)) >= 0)
             {
                 int TF=0;
                 stable = true;
                 mavlink_set_position_target_local_ned_t sp;
-                float Disx = target_ellipse_position[TargetNum].x ;
-                float Disy = target_ellipse_position[TargetNum].y ;
+                //对准的设定点按目标位置计算，记下目标位置来自哪一帧
+                uint64_t sp_frame, sp_capture;
+                latest_vision_frame(sp_frame, sp_capture);
+                float Disx, Disy;
+                target_offset(TargetNum, Disx, Disy);
                 float Adisx = fabsf(Disx);
                 float Adisy = fabsf(Disy);
                 int i = 0;
-                while((Adisx >= 10)||(Adisy >= 10))
+                while(((Adisx >= 10)||(Adisy >= 10)) && target_decision(TargetNum) < 0)
                 {
 
                     if (Adisx >= Adisy)
@@ -289,10 +452,10 @@ commands(Autopilot_Interface &api)
                     }
                     set_yaw(yaw, // [rad]
                             sp);
-                    api.update_local_setpoint(sp);
+                    api.update_local_setpoint(sp, sp_frame, sp_capture);
                     usleep(200000);
-                    Disx = target_ellipse_position[TargetNum].x ;
-                    Disy = target_ellipse_position[TargetNum].y ;
+                    latest_vision_frame(sp_frame, sp_capture);
+                    target_offset(TargetNum, Disx, Disy);
                     Adisx = fabsf(Disx);
                     Adisy = fabsf(Disy);
 
@@ -309,13 +472,16 @@ commands(Autopilot_Interface &api)
                 api.update_local_setpoint(sp);
                 usleep(100);
 
-                while (stable)
+                //目标已判定(resultTF同时清除stable)即结束对准和等待
+                while (stable && target_decision(TargetNum) < 0)
                 {
                     sleep(1);
                     TF++;
                     if (TF==10)
                     {
-                        int TplusF = target_ellipse_position[TargetNum].T_N + target_ellipse_position[TargetNum].F_N;
+                        target t;
+                        get_target(TargetNum, t);
+                        int TplusF = t.T_N + t.F_N;
                         if(TplusF <= 5 )
                         {
                             break;
@@ -327,12 +493,12 @@ commands(Autopilot_Interface &api)
                     }
                     else
                     {
-                        Disx = target_ellipse_position[TargetNum].x ;
-                        Disy = target_ellipse_position[TargetNum].y ;
+                        latest_vision_frame(sp_frame, sp_capture);
+                        target_offset(TargetNum, Disx, Disy);
                         Adisx = fabsf(Disx);
                         Adisy = fabsf(Disy);
 
-                        while((Adisx >= 10)||(Adisy >= 10))
+                        while(((Adisx >= 10)||(Adisy >= 10)) && target_decision(TargetNum) < 0)
                         {
 
                             if (Adisx >= Adisy)
@@ -345,10 +511,10 @@ commands(Autopilot_Interface &api)
                             }
                             set_yaw(yaw, // [rad]
                                     sp);
-                            api.update_local_setpoint(sp);
+                            api.update_local_setpoint(sp, sp_frame, sp_capture);
                             usleep(200000);
-                            Disx = target_ellipse_position[TargetNum].x ;
-                            Disy = target_ellipse_position[TargetNum].y ;
+                            latest_vision_frame(sp_frame, sp_capture);
+                            target_offset(TargetNum, Disx, Disy);
                             Adisx = fabsf(Disx);
                             Adisy = fabsf(Disy);
 
@@ -363,20 +529,16 @@ commands(Autopilot_Interface &api)
                         };
                     }
                 }
-                if (ellipse_T.size() > TNum)
+                if (count_T() > TNum)
                 {
 
                     TNum = api.Throw(yaw,TNum);
-                    TargetNum = TargetNum + 1;
                     detect= false;
                     flag = false;
                     break;
                 }
-                else
-                {
-                    TargetNum = TargetNum + 1;
-                }
             }
+            TargetNum = -1;
             t1.detach();
             detect= false;
             flag = false;
@@ -413,7 +575,13 @@ parse_commandline(int argc, char **argv, char *&uart_name, int &baudrate)
 {
 
     // string for command line usage
-    const char *commandline_usage = "usage: mavlink_serial -d <devicename> -b <baudrate>";
+    const char *commandline_usage = "usage: mavlink_serial -d <devicename> -b <baudrate> [--tlog <telemetry.tlog>]\n"
+                                    "       mavlink_serial --replay <video> <telemetry.tlog> [--wl <wl.tlog>] [--fast] [--speed x]\n"
+                                    "       mavlink_serial --to-raw <video> <frames.raw>\n"
+                                    "       mavlink_serial --bench-targets <number of targets>\n"
+                                    "       mavlink_serial --bench-rec <video> [minutes, default 30]\n"
+                                    "       mavlink_serial --dump-rois <video> <dir> [every n frames, default 10]\n"
+                                    "       mavlink_serial --train-tf <sample list> <model.yml>";
 
     // Read input arguments
     for (int i = 1; i < argc; i++) { // argv[0] is "mavlink"
@@ -482,27 +650,13 @@ quit_handler( int sig )
 
 }
 
-///////////////视觉定位线程
-void videothread(Autopilot_Interface& api){
-
-    VideoCapture cap(0);
-//    VideoCapture cap;
-//    cap.open("T_rotation.avi");
-//    cap.open("F.avi");
-//    cap.open("T.avi");
-    if(!cap.isOpened()) return;
-    int width = 640;
-    int height = 360;
-    cap.set(CV_CAP_PROP_FRAME_WIDTH, 1920);
-    cap.set(CV_CAP_PROP_FRAME_HEIGHT, 1080);
-    cap.set(CAP_PROP_AUTOFOCUS,0);
-
-
+// 椭圆检测器，videothread和--bench-rec使用同一组参数
+static CEllipseDetectorYaed*
+create_detector(int width, int height, int iThLength, float fTaoCenters)
+{
 //	 Parameters Settings (Sect. 4.2)
-    int		iThLength = 16;
     float	fThObb = 3.0f;
     float	fThPos = 1.0f;
-    float	fTaoCenters = 0.05f;
     int 	iNs = 16;
     float	fMaxCenterDistance = sqrt(float(width*width + height*height)) * fTaoCenters;
 
@@ -531,117 +685,240 @@ void videothread(Autopilot_Interface& api){
                         fMinReliability,
                         iNs
     );
+    // 视频流中相邻帧梯度分布接近，Canny阈值每10帧重新统计一次，其余帧沿用平滑后的阈值
+    yaed->SetCannyThresholdMode(CANNY_TH_CARRY, 0.2f, 10);
+    return yaed;
+}
 
-Mat1b gray, gray_big;
-ofstream outf1;
-outf1.open("target_r.txt");
-VideoWriter writer1("小图.avi", CV_FOURCC('M', 'J', 'P', 'G'), 5.0, Size(640, 360));
-	while(true) {
-
-        Mat3b image, image_r;
-        cap >> image;
-        resize(image, image_r, Size(640, 360), 0, 0, CV_INTER_LINEAR);
-        cvtColor(image_r, gray, COLOR_BGR2GRAY);
-        cvtColor(image, gray_big, COLOR_BGR2GRAY);
-
-        vector<Ellipse> ellsYaed, ellipse_in, ellipse_big, ellipseok;
-        vector<Mat1b> img_roi;
-        yaed->Detect(gray, ellsYaed);
-        Mat3b resultImage = image_r.clone();
-        Mat3b resultImage2 = image_r.clone();
-        vector<coordinate> ellipse_out, ellipse_TF, ellipse_out1;
-        if(getlocalposition){
-            OptimizEllipse(ellipse_in, ellsYaed);//对椭圆检测部分得到的椭圆进行预处理，输出仅有大圆的vector
-            if (!drop) {
-            yaed->targetcolor(resultImage2, ellipse_in, ellipse_big);
-//            filtellipse(api, ellipseok, ellipse_big);
-            yaed->DrawDetectedEllipses(resultImage, ellipse_out, ellipse_big);//绘制检测到的椭圆
-            vector<vector<Point> > contours;
-            if (stable) {
-                yaed->extracrROI(gray_big, ellipse_out, img_roi);
-                visual_rec(img_roi, ellipse_out, ellipse_TF, contours);//T和F的检测程序
-                ellipse_out1 = ellipse_TF;
-            } else
-                ellipse_out1 = ellipse_out;
-            for (auto &p:contours) {
-                vector<vector<Point> > contours1;
-                contours1.push_back(p);
-                drawContours(image, contours1, 0, Scalar(255, 255, 0), 1);
-            }
-            possible_ellipse(api, ellipse_out1, target_ellipse_position);
+// 离线工具的逐帧检测：缩放到640x360检测，取评分最高的4个椭圆按x排序，在原图上提取ROI，返回ROI的缩放系数
+static float
+detect_rois(CEllipseDetectorYaed* yaed, const Mat3b& image, vector<coordinate>& ellipse_out,
+            vector<Mat1b>& rois, bool roi_threshold)
+{
+    Mat3b image_r, no_overlay;
+    Mat1b gray;
+    vector<Ellipse> ells;
+    resize(image, image_r, Size(640, 360), 0, 0, CV_INTER_LINEAR);
+    cvtColor(image_r, gray, COLOR_BGR2GRAY);
+    yaed->Detect(gray, ells);
+    //评分最高的4个，按x排序
+    sort(ells.begin(), ells.end());
+    if (ells.size() > 4)
+        ells.resize(4);
+    stable_sort(ells.begin(), ells.end(), [](const Ellipse& l, const Ellipse& r) { return l._xc < r._xc; });
+
+    ellipse_out.clear();
+    rois.clear();
+    yaed->DrawDetectedEllipses(no_overlay, ellipse_out, ells);
+    float roi_scale = float(image.cols) / image_r.cols;
+    yaed->extracrROI(image, ellipse_out, rois, roi_threshold, roi_scale);
+    return roi_scale;
+}
 
-            if(stable) {
-                resultTF(api, target_ellipse_position, ellipse_T, ellipse_F);
-            }
-        } else {
-                yaed->targetcolor(resultImage2, ellipse_in, ellipse_big);
-//                filtellipse(api, ellipseok, ellipse_big);
-                yaed->DrawDetectedEllipses(resultImage, ellipse_out, ellipse_big);//绘制检测到的椭圆
-                getdroptarget(api, droptarget, ellipse_out);
-        }
+// ------------------------------------------------------------------------------
+//   Recognition benchmark
+// ------------------------------------------------------------------------------
+/*
+ * --bench-rec：不连接飞控，按录像逐帧检测椭圆、提取ROI并识别T/F(vision.yml中的recognition设置)，
+ * 每分钟视频输出一次累计的ROI数、按墙钟时间计的ROI/s和RSS，检查长时间回放时内存是否有界。
+ * 没有遥测时ROI不关联目标，识别缓存按帧内的顺序(x由小到大)当作目标编号。
+ */
+int
+BenchRecognition(const char *video, double minutes)
+{
+    FileStorage fs_vision("vision.yml", FileStorage::READ);
+    if (fs_vision.isOpened())
+        visual_rec_recognizer().Read(fs_vision["recognition"]);
+    bool roi_threshold = visual_rec_recognizer().GetThresholdMode() == TF_TH_SINGLE;
+
+    Frame_Source *source = open_frame_source(video, 1);
+    if (source == NULL) {
+        printf("usage: mavlink_serial --bench-rec <video> [minutes]\n");
+        return 1;
     }
-        cout << "target_ellipse.size = " << target_ellipse_position.size() << endl;
-        outf1 << "target_ellipse.size = " << target_ellipse_position.size() << endl;
-        for (int i = 0; i < target_ellipse_position.size(); ++i) {
-            cout << "x = " << target_ellipse_position[i].locx << endl
-                 << "y = " << target_ellipse_position[i].locy << endl
-                 << "T = " << target_ellipse_position[i].T_N << endl
-                 << "F = " << target_ellipse_position[i].F_N << endl
-                 << "flag = " << target_ellipse_position[i].possbile << endl;
-            outf1 << "x = " << target_ellipse_position[i].locx << endl
-                  << "y = " << target_ellipse_position[i].locy << endl
-                  << "T = " << target_ellipse_position[i].T_N << endl
-                  << "F = " << target_ellipse_position[i].F_N << endl
-                  << "flag = " << target_ellipse_position[i].possbile << endl;
+    double fps = source->fps() > 0 ? source->fps() : 30.;
+    uint64_t max_frames = minutes > 0 ? uint64_t(minutes * 60 * fps) : UINT64_MAX;
+    uint64_t report_frames = uint64_t(60 * fps);
+    CEllipseDetectorYaed* yaed = create_detector(640, 360, 16, 0.05f);
+
+    Mat3b image;
+    vector<coordinate> ellipse_out, ellipse_TF;
+    vector<Mat1b> rois;
+    vector< vector<Point> > contours;
+    visual_rec_recognizer().ResetStats();
+    long rss_start = get_rss_kb();
+    uint64_t frames = 0, rois_total = 0;
+    uint64_t t0 = get_monotonic_usec();
+    while (frames < max_frames && source->read(image)) {
+        ellipse_TF.clear();
+        contours.clear();
+        float roi_scale = detect_rois(yaed, image, ellipse_out, rois, roi_threshold);
+        visual_rec_recognizer().SetRoiScale(roi_scale);
+        visual_rec_recognizer().SetRoiThreshold(yaed->GetRoiThreshold());
+        for (size_t i = 0; i < ellipse_out.size(); i++)
+            ellipse_out[i].target = int16_t(i);
+        visual_rec(rois, ellipse_out, ellipse_TF, contours);
+        rois_total += rois.size();
+
+        if (++frames % report_frames == 0) {
+            double wall_s = (get_monotonic_usec() - t0) / 1e6;
+            printf("%5.1f min video: rois = %llu rois/s = %.1f rss = %ld kB\n", frames / fps / 60,
+                   (unsigned long long)rois_total, wall_s > 0 ? rois_total / wall_s : 0., get_rss_kb());
         }
-        cout << "ellipse_T.size = " << ellipse_T.size() << endl;
-        outf1 << "ellipse_T.size = " << ellipse_T.size() << endl;
-        for (int i = 0; i < ellipse_T.size(); ++i) {
-            cout << "x = " << ellipse_T[i].locx << endl
-                 << "y = " << ellipse_T[i].locy << endl
-                 << "possbile = " << ellipse_T[i].possbile << endl
-                 << "lat:" << ellipse_T[i].lat << "lon:" << ellipse_T[i].lon << endl
-                 <<"No.:"<<ellipse_T[i].num<<endl;
-            outf1 << "x = " << ellipse_T[i].locx << endl
-                  << "y = " << ellipse_T[i].locy << endl
-                  << "possbile = " << ellipse_T[i].possbile << endl
-                  << "lat:" << ellipse_T[i].lat << "lon:" << ellipse_T[i].lon << endl
-                  <<"No.:"<<ellipse_T[i].num<<endl;
+    }
+    double wall_s = (get_monotonic_usec() - t0) / 1e6;
+    const TFRecStats& rec = visual_rec_stats();
+    printf("bench-rec %s: %llu frames (%.1f min video) in %.1f s wall\n", source->name().c_str(),
+           (unsigned long long)frames, frames / fps / 60, wall_s);
+    printf("  rois = %llu, %.1f rois/s wall, %.1f rois/s inside recognition, cache hits = %llu (%.1f%%)\n",
+           (unsigned long long)rois_total, wall_s > 0 ? rois_total / wall_s : 0.,
+           rec.dTimeMs > 0 ? rec.uRois * 1000. / rec.dTimeMs : 0., (unsigned long long)rec.uCacheHits,
+           rec.uRois ? rec.uCacheHits * 100. / rec.uRois : 0.);
+    printf("  rss start = %ld kB, end = %ld kB\n", rss_start, get_rss_kb());
+    delete yaed;
+    delete source;
+    return 0;
+}
+
+// ------------------------------------------------------------------------------
+//   ROI dump
+// ------------------------------------------------------------------------------
+/*
+ * --dump-rois：按录像每隔every帧检测一次，把extracrROI输出的灰度ROI(未二值化)写到dir，
+ * 同时写dir/list.txt，每行"图片路径 ?"。把?改为T或F即为--train-tf的样本列表，仍为?的行训练时跳过。
+ */
+int
+DumpRois(const char *video, const char *dir, int every)
+{
+    Frame_Source *source = open_frame_source(video, 1);
+    if (source == NULL) {
+        printf("usage: mavlink_serial --dump-rois <video> <dir> [every n frames]\n");
+        return 1;
+    }
+    string list_path = string(dir) + "/list.txt";
+    ofstream list(list_path.c_str());
+    if (!list.is_open()) {
+        printf("cannot write %s\n", list_path.c_str());
+        delete source;
+        return 1;
+    }
+    if (every < 1)
+        every = 1;
+    CEllipseDetectorYaed* yaed = create_detector(640, 360, 16, 0.05f);
+
+    Mat3b image;
+    vector<coordinate> ellipse_out;
+    vector<Mat1b> rois;
+    uint64_t frames = 0, written = 0;
+    char name[64];
+    while (source->read(image)) {
+        if (frames++ % every != 0)
+            continue;
+        detect_rois(yaed, image, ellipse_out, rois, false);
+        for (size_t i = 0; i < rois.size(); i++) {
+            if (CTFClassifier::Degenerate(rois[i]))
+                continue;
+            snprintf(name, sizeof(name), "/roi_%06llu_%d.png", (unsigned long long)(frames - 1), int(i));
+            string path = string(dir) + name;
+            if (!imwrite(path, rois[i])) {
+                printf("cannot write %s\n", path.c_str());
+                continue;
+            }
+            list << path << " ?" << endl;
+            written++;
         }
-        cout << "ellipse_F.size = " << ellipse_F.size() << endl;
-        outf1 << "ellipse_F.size = " << ellipse_F.size() << endl;
-        for (int i = 0; i < ellipse_F.size(); ++i) {
-            cout << "x = " << ellipse_F[i].locx << endl
-                 << "y = " << ellipse_F[i].locy << endl
-                 << "possbile = " << ellipse_F[i].possbile << endl
-                 << "lat:" << ellipse_F[i].lat << "lon:" << ellipse_F[i].lon << endl
-                 <<"No.:"<<ellipse_F[i].num<<endl;
-            outf1 << "x = " << ellipse_F[i].locx << endl
-                  << "y = " << ellipse_F[i].locy << endl
-                  << "possbile = " << ellipse_F[i].possbile << endl
-                  << "lat:" << ellipse_F[i].lat << "lon:" << ellipse_F[i].lon << endl
-                  <<"No.:"<<ellipse_F[i].num<<endl;
+    }
+    printf("dump-rois %s: %llu rois from %llu frames, label them in %s\n", source->name().c_str(),
+           (unsigned long long)written, (unsigned long long)frames, list_path.c_str());
+    delete yaed;
+    delete source;
+    return 0;
+}
+
+///////////////视觉定位线程
+void videothread(Autopilot_Interface& api){
+
+    // 帧源：相机(默认camera:0)、录像文件、MJPEG文件或--to-raw转换的.raw文件，回放时为--replay指定的录像
+    FileStorage fs_vision("vision.yml", FileStorage::READ);
+    string source_spec = "camera:0";
+    int decode_scale = 0;
+    if (fs_vision.isOpened() && !fs_vision["pipeline"]["source"].empty())
+        source_spec = (string)fs_vision["pipeline"]["source"];
+    if (fs_vision.isOpened() && !fs_vision["pipeline"]["decode_scale"].empty())
+        decode_scale = (int)fs_vision["pipeline"]["decode_scale"];
+    if (!replay_options.video.empty())
+        source_spec = replay_options.video;
+//    source_spec = "T_rotation.avi";
+//    source_spec = "F.avi";
+//    source_spec = "T.avi";
+    Frame_Source *source = open_frame_source(source_spec, decode_scale);
+    if (source == NULL) return;
+    int width = 640;
+    int height = 360;
+
+
+    int		iThLength = 16;
+    float	fTaoCenters = 0.05f;
+    CEllipseDetectorYaed* yaed = create_detector(width, height, iThLength, fTaoCenters);
+
+    // 候选椭圆过滤链，阈值及各任务阶段的过滤步骤从vision.yml读取，无需重新编译
+    CandidateFilterParams filter_params;
+    CCandidateFilterChain filter_chain;
+    int pipeline_depth = 1;
+    double pipeline_fps = 0;
+    bool show = false;
+    Record_Params record_params;
+    Resolution_Params resolution_params;
+    resolution_params.th_length = iThLength;
+    resolution_params.tao_centers = fTaoCenters;
+    string log_file = "frames.flog";
+    int log_capacity = 36000;
+    double summary_s = 1.0;
+    if (fs_vision.isOpened()) {
+        if (!fs_vision["pipeline"]["depth"].empty())
+            pipeline_depth = max((int)fs_vision["pipeline"]["depth"], 1);
+        if (!fs_vision["pipeline"]["fps"].empty())
+            pipeline_fps = max((double)fs_vision["pipeline"]["fps"], 0.);
+        if (!fs_vision["pipeline"]["show"].empty())
+            show = (int)fs_vision["pipeline"]["show"] != 0;
+        record_params.Read(fs_vision["recording"]);
+        resolution_params.Read(fs_vision["resolution"]);
+        Tracker_Params tracker_params;
+        tracker_params.Read(fs_vision["tracker"]);
+        {
+            std::lock_guard<std::mutex> lock(target_mutex);//任务线程可能已在读取判定
+            target_tracker.set_params(tracker_params);
         }
-        cout<<"local_position.x:"<<api.current_messages.local_position_ned.x<<endl
-            <<"local_position.y:"<<api.current_messages.local_position_ned.y<<endl
-            <<"local_position.z:"<<api.current_messages.local_position_ned.z<<endl;
-        cout<<"stable:"<<stable<<endl<<"updateellipise:"<<updateellipse<<endl<<"drop:"<<drop<<endl;
-        cout<<"target_Num:"<<TargetNum<<endl;
-        outf1<<"local_position.x:"<<api.current_messages.local_position_ned.x<<endl
-             <<"local_position.y:"<<api.current_messages.local_position_ned.y<<endl
-             <<"local_position.z:"<<api.current_messages.local_position_ned.z<<endl;
-        outf1<<"stable:"<<stable<<endl<<"updateellipise:"<<updateellipse<<endl<<"drop:"<<drop<<endl;
-        outf1<<"target_Num:"<<TargetNum<<endl;
-//		namedWindow("原图",1);
-//		imshow("原图", image);
-//		namedWindow("缩小",1);
-//		imshow("缩小", resultImage);
-		writer1.write(resultImage);
-        ellipse_out.clear();
-		waitKey(10);
-		ellipse_out1.clear();
-		usleep(1000);
-	}
+        FileNode log = fs_vision["log"];
+        if (!log["file"].empty())
+            log_file = (string)log["file"];
+        if (!log["capacity"].empty())
+            log_capacity = max((int)log["capacity"], 1);
+        if (!log["summary_s"].empty())
+            summary_s = max((double)log["summary_s"], 0.);
+        filter_params.Read(fs_vision["filter"]);
+        filter_chain.LoadPhases(fs_vision["phases"]);
+        visual_rec_recognizer().Read(fs_vision["recognition"]);
+    }
+    bool roi_threshold = visual_rec_recognizer().GetThresholdMode() == TF_TH_SINGLE;
+
+    // 采集、预处理、检测、识别融合、输出各一个线程，阶段之间用有界队列连接
+    Vision_Pipeline pipeline(api, *source, yaed, filter_chain, filter_params, roi_threshold, pipeline_depth);
+    pipeline.set_pacing(pipeline_fps, show);
+    if (replay_options.clock) {
+        Replay_Frame_Times times;
+        read_video_times(source->name(), source->fps(),
+                         tlog_first_usec(replay_options.tlog.c_str()), times);
+        pipeline.set_replay(replay_options.clock, times);
+    }
+    pipeline.set_resolution(resolution_params);
+    pipeline.set_recording(record_params);
+    pipeline.set_log(log_file, log_capacity, summary_s);
+    uint64_t run_start = get_monotonic_usec();
+    pipeline.run();
+    double run_s = (get_monotonic_usec() - run_start) / 1e6;
+    vision_fps = run_s > 0 ? pipeline.frames_out() / run_s : 0.;
+    delete source;
 }
 // ------------------------------------------------------------------------------
 //   Main
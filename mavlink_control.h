@@ -67,6 +67,7 @@ int top(int argc, char **argv);
 
 
 void commands(Autopilot_Interface &autopilot_interface);
+int replay(bool fast, double speed);
 void parse_commandline(int argc, char **argv, char *&uart_name, int &baudrate);
 
 // quit handler
@@ -74,5 +75,7 @@ Autopilot_Interface *autopilot_interface_quit;
 Serial_Port *serial_port_quit;
 void quit_handler( int sig );
 void videothread(Autopilot_Interface& api);
+int BenchRecognition(const char *video, double minutes);
+int DumpRois(const char *video, const char *dir, int every);
 
 
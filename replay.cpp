@@ -0,0 +1,195 @@
+/**
+ * @file replay.cpp
+ *
+ * @brief Offline replay of a recorded flight
+ *
+ */
+
+#include "replay.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <fstream>
+#include <sys/time.h>
+
+static uint64_t
+wall_usec()
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec * 1000000ULL + tv.tv_usec;
+}
+
+// ------------------------------------------------------------------------------
+//   Replay Clock
+// ------------------------------------------------------------------------------
+Replay_Clock::
+Replay_Clock() :
+	fast(false), speed(1.0), started(false), video_started(false), finished(false), stopped(false),
+	log_start(0), wall_start(0), current(0)
+{
+}
+
+void
+Replay_Clock::
+configure(bool fast_, double speed_)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	fast = fast_;
+	speed = speed_ > 0 ? speed_ : 1.0;
+}
+
+uint64_t
+Replay_Clock::
+realtime_now()
+{
+	return log_start + uint64_t((wall_usec() - wall_start) * speed);
+}
+
+uint64_t
+Replay_Clock::
+now()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	if (!started)
+		return 0;
+	return (fast && video_started) ? current : realtime_now();
+}
+
+void
+Replay_Clock::
+wait_frame(uint64_t log_us)
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	if (!started) {
+		started = true;
+		log_start = log_us;
+		wall_start = wall_usec();
+	}
+	if (fast)
+		return;
+	// 实时模式：等到该帧在回放时间线上的时刻
+	while (!stopped && realtime_now() < log_us) {
+		uint64_t wait_us = uint64_t((log_us - realtime_now()) / speed);
+		cond.wait_for(lock, std::chrono::microseconds(wait_us));
+	}
+}
+
+void
+Replay_Clock::
+advance(uint64_t log_us)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (!fast)
+			return;
+		if (!video_started) {
+			video_started = true;
+			current = log_us;
+		}
+		if (log_us > current)
+			current = log_us;
+	}
+	cond.notify_all();
+}
+
+void
+Replay_Clock::
+finish()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		finished = true;
+	}
+	cond.notify_all();
+}
+
+void
+Replay_Clock::
+stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopped = true;
+	}
+	cond.notify_all();
+}
+
+void
+Replay_Clock::
+wait_telemetry(uint64_t log_us)
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	if (!started) {
+		started = true;
+		log_start = log_us;
+		wall_start = wall_usec();
+	}
+	while (!stopped && !finished) {
+		if (fast && video_started) {
+			if (current >= log_us)
+				return;
+			cond.wait(lock);
+		} else {
+			uint64_t t = realtime_now();
+			if (t >= log_us)
+				return;
+			// 视频开始后快速模式会改由advance唤醒，等待时间不超过100ms
+			uint64_t wait_us = uint64_t((log_us - t) / speed);
+			cond.wait_for(lock, std::chrono::microseconds(wait_us < 100000 ? wait_us : 100000));
+		}
+	}
+}
+
+// ------------------------------------------------------------------------------
+//   Files
+// ------------------------------------------------------------------------------
+uint64_t
+tlog_first_usec(const char *file)
+{
+	FILE *fp = fopen(file, "rb");
+	if (fp == NULL)
+		return 0;
+	uint8_t b[8];
+	uint64_t t = 0;
+	if (fread(b, 1, 8, fp) == 8) {
+		for (int i = 0; i < 8; i++)
+			t = (t << 8) | b[i];
+	}
+	fclose(fp);
+	return t;
+}
+
+void
+read_video_times(const std::string &video, double fps, uint64_t start_us, Replay_Frame_Times &times)
+{
+	times.times.clear();
+	times.start_us = start_us;
+	times.period_us = uint64_t(1e6 / (fps > 0 ? fps : 10));
+
+	std::ifstream idx((video + ".idx").c_str());
+	std::string line;
+	while (std::getline(idx, line)) {
+		if (line.empty() || line[0] == '#')
+			continue;
+		// video_frame,frame_id,stamp_us,time_usec,...
+		size_t pos = 0;
+		for (int field = 0; field < 3 && pos != std::string::npos; field++) {
+			pos = line.find(',', pos);
+			if (pos != std::string::npos)
+				pos++;
+		}
+		if (pos == std::string::npos)
+			continue;
+		times.times.push_back(strtoull(line.c_str() + pos, NULL, 10));
+	}
+
+	if (times.times.size() > 1)
+		times.period_us = (times.times.back() - times.times.front()) / (times.times.size() - 1);
+	if (!times.times.empty())
+		printf("replay: %u frame times from %s.idx\n", (unsigned)times.times.size(), video.c_str());
+	else
+		printf("replay: no %s.idx, assuming %.1f fps from the first telemetry message\n", video.c_str(),
+		       1e6 / times.period_us);
+}
@@ -0,0 +1,114 @@
+/**
+ * @file replay.h
+ *
+ * @brief Offline replay of a recorded flight
+ *
+ * A recorded video (with the <video>.idx sidecar written by the recorder)
+ * and recorded MAVLink telemetry (.tlog: 8 byte big-endian unix time in us
+ * followed by the raw packet, the format written with --tlog and by common
+ * ground stations) are fed through the unchanged vision pipeline and
+ * autopilot interface. The Serial_Port reads the tlog instead of the UART
+ * and the frame grabber reads the video file instead of the camera.
+ *
+ * Replay_Clock keeps both streams on the recorded time line:
+ *  - real time: log time runs at `speed` times wall time; telemetry and video
+ *    frames are released when their time comes, frames the pipeline is too
+ *    slow for are skipped like with the camera;
+ *  - fast: every video frame is processed (lossless grabber) as fast as the
+ *    pipeline runs, and the log time is the time of the frame the classify
+ *    stage fused last, so telemetry is released in step with the video and a
+ *    frame never sees telemetry recorded after the frames behind it. Before the first frame the
+ *    clock runs in real time.
+ *
+ * This header only uses the standard library.
+ *
+ */
+
+#ifndef REPLAY_H_
+#define REPLAY_H_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+
+class Replay_Clock
+{
+public:
+
+	Replay_Clock();
+
+	// fast: 视频驱动，不按实际时间等待；speed: 实时模式的倍速
+	void configure(bool fast_, double speed_ = 1.0);
+	bool is_fast() const { return fast; }
+
+	// 视频帧：实时模式下等到该帧的时刻，快速模式下立即返回
+	void wait_frame(uint64_t log_us);
+	// 快速模式下流水线融合完一帧后推进日志时间
+	void advance(uint64_t log_us);
+	// 视频结束，之后的遥测不再等待
+	void finish();
+
+	// 遥测：等到日志时间到达log_us
+	void wait_telemetry(uint64_t log_us);
+
+	// 当前日志时间，尚未开始时为0
+	uint64_t now();
+
+	void stop();
+
+private:
+
+	uint64_t realtime_now();                // 需持有mutex
+
+	std::mutex mutex;
+	std::condition_variable cond;
+	bool fast;
+	double speed;
+	bool started;
+	bool video_started;
+	bool finished;
+	bool stopped;
+	uint64_t log_start;
+	uint64_t wall_start;
+	uint64_t current;
+};
+
+// 命令行中的回放设置
+struct Replay_Options
+{
+	std::string video;                      // 为空时不回放
+	std::string tlog;                       // 飞控链路
+	std::string wl_tlog;                    // 机间链路，为空时不运行任务流程，只运行视觉线程
+	Replay_Clock *clock;
+
+	Replay_Options() : clock(NULL) {}
+};
+
+// 录像中各帧的采集时刻(系统时钟)，索引之外的帧按period_us外推
+struct Replay_Frame_Times
+{
+	std::vector<uint64_t> times;
+	uint64_t start_us;
+	uint64_t period_us;
+
+	Replay_Frame_Times() : start_us(0), period_us(100000) {}
+
+	uint64_t at(size_t frame) const
+	{
+		if (frame < times.size())
+			return times[frame];
+		uint64_t last = times.empty() ? start_us : times.back();
+		size_t extra = times.empty() ? frame : frame - times.size() + 1;
+		return last + extra * period_us;
+	}
+};
+
+// tlog中第一条消息的时间，失败返回0
+uint64_t tlog_first_usec(const char *file);
+
+// 读取录像索引<video>.idx；没有索引时按帧率从start_us(遥测起始时间)起排列
+void read_video_times(const std::string &video, double fps, uint64_t start_us, Replay_Frame_Times &times);
+
+#endif // REPLAY_H_
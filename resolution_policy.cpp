@@ -0,0 +1,161 @@
+/**
+ * @file resolution_policy.cpp
+ *
+ * @brief Altitude adaptive working resolution of the ellipse detector
+ *
+ */
+
+#include "resolution_policy.h"
+
+// ------------------------------------------------------------------------------
+//   Parameters
+// ------------------------------------------------------------------------------
+Resolution_Params::
+Resolution_Params() :
+	adaptive(false), target_radius(1.f), height_offset(-12.f), min_radius(12.f), hysteresis(0.2f),
+	hold_frames(10), th_length(16), length_ratio(1.f), min_length(8), tao_centers(0.05f),
+	size_min(0.5f), size_max(2.f)
+{
+	widths.push_back(640);
+}
+
+void
+Resolution_Params::
+Read(const FileNode &node)
+{
+	if (node.empty())
+		return;
+	if (!node["adaptive"].empty())
+		adaptive = (int)node["adaptive"] != 0;
+	if (!node["widths"].empty()) {
+		vector<int> w;
+		node["widths"] >> w;
+		widths.clear();
+		for (size_t i = 0; i < w.size(); i++) {
+			// 宽度为16的倍数，高度按16:9取整
+			if (w[i] >= 64 && w[i] <= 640)
+				widths.push_back(w[i] / 16 * 16);
+		}
+		sort(widths.begin(), widths.end(), greater<int>());
+		widths.erase(unique(widths.begin(), widths.end()), widths.end());
+		if (widths.empty() || widths[0] != 640)
+			widths.insert(widths.begin(), 640);
+	}
+	if (!node["target_radius"].empty())
+		target_radius = max((float)node["target_radius"], 0.01f);
+	if (!node["height_offset"].empty())
+		height_offset = (float)node["height_offset"];
+	if (!node["min_radius"].empty())
+		min_radius = max((float)node["min_radius"], 1.f);
+	if (!node["hysteresis"].empty())
+		hysteresis = min(max((float)node["hysteresis"], 0.f), 0.9f);
+	if (!node["hold_frames"].empty())
+		hold_frames = max((int)node["hold_frames"], 0);
+	if (!node["length_ratio"].empty())
+		length_ratio = max((float)node["length_ratio"], 0.f);
+	if (!node["min_length"].empty())
+		min_length = max((int)node["min_length"], 2);
+	FileNode prior = node["size_prior"];
+	if (prior.isSeq() && prior.size() == 2) {
+		size_min = (float)prior[0];
+		size_max = (float)prior[1];
+	}
+}
+
+// ------------------------------------------------------------------------------
+//   Policy
+// ------------------------------------------------------------------------------
+Resolution_Policy::
+Resolution_Policy(const Resolution_Params &params_) :
+	hold(0), switches(0)
+{
+	for (int i = 0; i < MAX_LEVELS; i++)
+		frames[i] = 0;
+	set_params(params_);
+}
+
+void
+Resolution_Policy::
+set_params(const Resolution_Params &params_)
+{
+	params = params_;
+	if (params.widths.size() > size_t(MAX_LEVELS))
+		params.widths.resize(MAX_LEVELS);
+	hold = 0;
+	apply(0, 0.f);
+}
+
+void
+Resolution_Policy::
+apply(int level, float radius)
+{
+	int width = params.widths[level];
+	work.level = level;
+	work.size = Size(width, width * 9 / 16);
+	work.scale = width / 640.f;
+	work.radius = radius;
+	// 目标占满画面时弧段可能被图像边界截断，iThLength不超过图像高度的1/4
+	if (radius > 0)
+		work.th_length = max(params.min_length, min(cvRound(params.length_ratio * radius * work.scale),
+		                                            work.size.height / 4));
+	else
+		work.th_length = max(params.min_length, cvRound(params.th_length * work.scale));
+	work.center_distance = params.tao_centers * sqrt(float(work.size.width * work.size.width + work.size.height * work.size.height));
+}
+
+const Work_Resolution &
+Resolution_Policy::
+update(const mavlink_local_position_ned_t &position, bool valid)
+{
+	// 高度与realtarget()相同：起飞点以上的高度加上目标所在的高度差
+	float h = -position.z + params.height_offset;
+	float radius = (valid && params.adaptive && h > 1.f) ? params.target_radius * fx / h : 0.f;
+
+	int level = work.level;
+	int levels = int(params.widths.size());
+	if (radius <= 0) {
+		level = 0;
+	} else {
+		// 预计半径不小于min_radius的最小分辨率
+		int want = 0;
+		for (int i = levels - 1; i > 0; i--) {
+			if (radius * params.widths[i] / 640.f >= params.min_radius) {
+				want = i;
+				break;
+			}
+		}
+		if (want > level) {
+			// 降低分辨率：留出余量，并且距上次切换已有hold_frames帧
+			if (hold >= params.hold_frames) {
+				for (int i = want; i > level; i--) {
+					if (radius * params.widths[i] / 640.f >= params.min_radius * (1 + params.hysteresis)) {
+						level = i;
+						break;
+					}
+				}
+			}
+		} else if (want < level) {
+			// 提高分辨率：当前级别的半径低于下限减去余量时立即切换
+			if (radius * params.widths[level] / 640.f < params.min_radius * (1 - params.hysteresis))
+				level = want;
+		}
+	}
+
+	if (level != work.level) {
+		switches++;
+		hold = 0;
+	} else
+		hold++;
+	apply(level, radius);
+	frames[level]++;
+	return work;
+}
+
+bool
+Resolution_Policy::
+accept_size(const Work_Resolution &work, const Resolution_Params &params, float a)
+{
+	if (work.radius <= 0)
+		return true;
+	return a >= params.size_min * work.radius && a <= params.size_max * work.radius;
+}
@@ -0,0 +1,104 @@
+/**
+ * @file resolution_policy.h
+ *
+ * @brief Altitude adaptive working resolution of the ellipse detector
+ *
+ * The detector used to run on 640x360 at every altitude. The expected target
+ * radius in the 640x360 image follows from the height above the targets
+ * (same model as realtarget(): -z plus the field offset) and the camera focal
+ * length. The policy picks the smallest configured working width at which
+ * that radius still has min_radius pixels, and derives the detector
+ * parameters from it:
+ *  - iThLength: length_ratio * expected radius in working pixels;
+ *  - fMaxCenterDistance: tao_centers * image diagonal (as before, per size);
+ *  - size prior: only candidates whose semi major axis is within
+ *    [size_min, size_max] times the expected radius pass the "size" stage of
+ *    the candidate filter chain.
+ *
+ * Detected ellipses are scaled back to 640x360 before filtering, so the color
+ * filter, ROI extraction and target geometry are unchanged. Going to a smaller
+ * resolution needs a margin (hysteresis) and hold_frames frames since the last
+ * switch; going back up happens as soon as the radius falls below the margin.
+ * Without a valid altitude the detector runs on 640x360 with the old
+ * parameters.
+ *
+ */
+
+#ifndef RESOLUTION_POLICY_H_
+#define RESOLUTION_POLICY_H_
+
+#include <atomic>
+
+#include "autopilot_interface.h"
+
+// vision.yml中resolution一节
+struct Resolution_Params
+{
+	bool adaptive;
+	vector<int> widths;                     // 可选的检测图宽度(16:9)，从大到小
+	float target_radius;                    // 目标外圈半径 m
+	float height_offset;                    // 目标相对起飞点的高度 m
+	float min_radius;                       // 检测图中目标半径的下限 像素
+	float hysteresis;                       // 降低分辨率时对min_radius的相对余量
+	int hold_frames;                        // 切换后至少保持的帧数(降低分辨率时)
+	int th_length;                          // 640*360且高度未知时的iThLength
+	float length_ratio;                     // iThLength = length_ratio * 预计半径(检测图像素)
+	int min_length;
+	float tao_centers;                      // fMaxCenterDistance = tao_centers * 对角线
+	float size_min, size_max;               // 尺寸先验：半长轴与预计半径之比
+
+	Resolution_Params();
+
+	// 缺省的项保留默认值
+	void Read(const FileNode &node);
+};
+
+// 一帧检测使用的分辨率和参数
+struct Work_Resolution
+{
+	int level;                              // widths中的序号
+	Size size;
+	float scale;                            // size.width / 640
+	int th_length;
+	float center_distance;
+	float radius;                           // 640*360下目标的预计半径，0为未知(不使用尺寸先验)
+
+	Work_Resolution() : level(0), size(640, 360), scale(1.f), th_length(16), center_distance(0.f), radius(0.f) {}
+};
+
+class Resolution_Policy
+{
+public:
+
+	explicit Resolution_Policy(const Resolution_Params &params_ = Resolution_Params());
+
+	void set_params(const Resolution_Params &params_);
+
+	// 按当前高度选择这一帧的工作分辨率，valid为false时(没有本地位置)使用640*360
+	const Work_Resolution &update(const mavlink_local_position_ned_t &position, bool valid);
+
+	const Work_Resolution &current() const { return work; }
+
+	// 尺寸先验，a为640*360下的半长轴
+	static bool accept_size(const Work_Resolution &work, const Resolution_Params &params, float a);
+	const Resolution_Params &get_params() const { return params; }
+
+	uint64_t get_switches() const { return switches; }
+	// 各级别处理的帧数
+	uint64_t get_frames(int level) const { return level < MAX_LEVELS ? frames[level].load() : 0; }
+	int get_levels() const { return int(params.widths.size()); }
+
+private:
+
+	void apply(int level, float radius);
+
+	static const int MAX_LEVELS = 8;
+
+	Resolution_Params params;
+	Work_Resolution work;
+	int hold;                               // 距上次切换的帧数
+	std::atomic<uint64_t> switches;
+	std::atomic<uint64_t> frames[MAX_LEVELS];
+};
+
+#endif // RESOLUTION_POLICY_H_
@@ -53,6 +53,8 @@
 // ------------------------------------------------------------------------------
 
 #include "serial_port.h"
+#include "replay.h"
+#include <sys/time.h>
 
 
 // ----------------------------------------------------------------------------------
@@ -79,6 +81,9 @@ Serial_Port()
 Serial_Port::
 ~Serial_Port()
 {
+	if (tlog)
+		fclose(tlog);
+
 	// destroy mutex
 	pthread_mutex_destroy(&lock);
 }
@@ -95,6 +100,13 @@ initialize_defaults()
 	uart_name = (char*)"/dev/ttyUSB0";
 	baudrate  = 57600;
 
+	replay = false;
+	replay_clock = NULL;
+	replay_len = replay_pos = 0;
+	replay_messages = replay_writes = 0;
+	replay_last_us = 0;
+	tlog = NULL;
+
 	// Start mutex
 	int result = pthread_mutex_init(&lock, NULL);
 	if ( result != 0 )
@@ -143,11 +155,23 @@ read_message(mavlink_message_t &message)
 	}
 
 	// Couldn't read from port
-	else
+	else if (!replay)
 	{
 		fprintf(stderr, "ERROR: Could not read from fd %d\n", fd);
 	}
 
+	if (msgReceived && tlog)
+	{
+		struct timeval tv;
+		gettimeofday(&tv, NULL);
+		uint64_t t = tv.tv_sec * 1000000ULL + tv.tv_usec;
+		uint8_t buffer[8 + MAVLINK_MAX_PACKET_LEN];
+		for (int i = 0; i < 8; i++)
+			buffer[i] = uint8_t(t >> (56 - 8 * i));
+		unsigned len = mavlink_msg_to_send_buffer(buffer + 8, &message);
+		fwrite(buffer, 1, 8 + len, tlog);
+	}
+
 	// --------------------------------------------------------------------------
 	//   DEBUGGING REPORTS
 	// --------------------------------------------------------------------------
@@ -214,6 +238,20 @@ void
 Serial_Port::
 open_serial()
 {
+	if (replay)
+	{
+		// 回放：读tlog文件，没有文件的链路保持空闲
+		fd = (uart_name && uart_name[0]) ? open(uart_name, O_RDONLY) : -2;
+		if (fd == -1)
+		{
+			printf("failure, could not open replay log %s.\n", uart_name);
+			throw EXIT_FAILURE;
+		}
+		printf("Replaying %s\n", fd >= 0 ? uart_name : "(idle link)");
+		lastStatus.packet_rx_drop_count = 0;
+		status = true;
+		return;
+	}
 
 	// --------------------------------------------------------------------------
 	//   OPEN PORT
@@ -272,7 +310,8 @@ close_serial()
 {
 	printf("CLOSE PORT\n");
 
-	int result = close(fd);
+	int result = fd >= 0 ? close(fd) : 0;
+	fd = -1;
 
 	if ( result )
 	{
@@ -289,6 +328,23 @@ close_serial()
 // ------------------------------------------------------------------------------
 //   Convenience Functions
 // ------------------------------------------------------------------------------
+void
+Serial_Port::
+set_replay(Replay_Clock *clock)
+{
+	replay = true;
+	replay_clock = clock;
+}
+
+void
+Serial_Port::
+record_tlog(const char *file)
+{
+	tlog = fopen(file, "wb");
+	if (tlog == NULL)
+		fprintf(stderr, "WARNING: could not open %s for telemetry logging\n", file);
+}
+
 void
 Serial_Port::
 start()
@@ -505,6 +561,18 @@ Serial_Port::
 _read_port(uint8_t &cp)
 {
 
+	if (replay)
+	{
+		if (replay_pos == replay_len && !_read_replay_packet())
+		{
+			// 日志读完或空闲链路：与串口无数据时一样等待
+			usleep(100000);
+			return 0;
+		}
+		cp = replay_buf[replay_pos++];
+		return 1;
+	}
+
 	// Lock
 	pthread_mutex_lock(&lock);
 
@@ -525,6 +593,12 @@ Serial_Port::
 _write_port(char *buf, unsigned len)
 {
 
+	if (replay)
+	{
+		replay_writes++;
+		return len;
+	}
+
 	// Lock
 	pthread_mutex_lock(&lock);
 
@@ -542,3 +616,69 @@ _write_port(char *buf, unsigned len)
 }
 
 
+// ------------------------------------------------------------------------------
+//   Read one packet from the replay log
+// ------------------------------------------------------------------------------
+// 记录时间：第一条为2001年到2100年之间的unix时间，之后与上一条相差不超过一小时
+bool
+Serial_Port::
+_replay_time_valid(uint64_t t) const
+{
+	if (replay_last_us == 0)
+		return t > 978307200000000ULL && t < 4102444800000000ULL;
+	return t + 3600000000ULL > replay_last_us && t < replay_last_us + 3600000000ULL;
+}
+
+// tlog: 8字节大端时间(us) + 完整的MAVLink数据包(本程序使用的MAVLink 1.0)
+bool
+Serial_Port::
+_read_replay_packet()
+{
+	if (fd < 0)
+		return false;
+
+	uint8_t head[10];
+	if (read(fd, head, 10) != 10)
+		return false;
+	uint64_t t = 0;
+	for (int i = 0; i < 8; i++)
+		t = (t << 8) | head[i];
+	if (head[8] != MAVLINK_STX || !_replay_time_valid(t))
+	{
+		// 损坏或截断的记录：逐字节向后找下一个"合理的时间 + STX"重新对齐，找不到时链路转为空闲
+		uint64_t skipped = 0;
+		for (;;)
+		{
+			memmove(head, head + 1, 9);
+			if (read(fd, head + 9, 1) != 1)
+			{
+				fprintf(stderr, "ERROR: bad packet in replay log %s, no valid packet after it, link idle\n", uart_name);
+				close(fd);
+				fd = -2;
+				return false;
+			}
+			skipped++;
+			t = 0;
+			for (int i = 0; i < 8; i++)
+				t = (t << 8) | head[i];
+			if (head[8] == MAVLINK_STX && _replay_time_valid(t))
+				break;
+		}
+		fprintf(stderr, "WARNING: bad packet in replay log %s, skipped %llu bytes\n", uart_name, (unsigned long long)skipped);
+	}
+	replay_last_us = t;
+
+	unsigned len = MAVLINK_NUM_NON_PAYLOAD_BYTES + head[9];
+	replay_buf[0] = head[8];
+	replay_buf[1] = head[9];
+	if (read(fd, replay_buf + 2, len - 2) != int(len - 2))
+		return false;
+	replay_len = len;
+	replay_pos = 0;
+	replay_messages++;
+
+	// 等到回放时间线到达这条消息的时刻
+	if (replay_clock)
+		replay_clock->wait_telemetry(t);
+	return true;
+}
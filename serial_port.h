@@ -91,6 +91,7 @@
 // ------------------------------------------------------------------------------
 
 //class Serial_Port;
+class Replay_Clock;
 
 
 
@@ -124,6 +125,14 @@ public:
 	int read_message(mavlink_message_t &message);
 	int write_message(const mavlink_message_t &message);
 
+	// 回放：uart_name为tlog文件(为空时不产生任何消息)，按clock的时间线读出，写入的消息只计数
+	void set_replay(Replay_Clock *clock);
+	// 把收到的消息记录为tlog(每条消息前为8字节大端的系统时间us)
+	void record_tlog(const char *file);
+
+	uint64_t replay_messages;
+	uint64_t replay_writes;
+
 	void open_serial();
 	void close_serial();
 
@@ -143,6 +152,17 @@ private:
 	int  _read_port(uint8_t &cp);
 	int _write_port(char *buf, unsigned len);
 
+	bool replay;
+	Replay_Clock *replay_clock;
+	uint8_t replay_buf[MAVLINK_MAX_PACKET_LEN];
+	unsigned replay_len;
+	unsigned replay_pos;
+	uint64_t replay_last_us;                // 上一条记录的时间，重新对齐时判断时间是否合理
+	bool _read_replay_packet();
+	bool _replay_time_valid(uint64_t t) const;
+
+	FILE *tlog;
+
 };
 
 
@@ -0,0 +1,108 @@
+/**
+ * @file spsc_queue.h
+ *
+ * @brief Bounded single-producer / single-consumer ring buffer
+ *
+ * Lock free: the producer only writes _tail, the consumer only writes _head.
+ * push() and pop() block with a short back-off while the queue is full / empty
+ * (backpressure between the vision pipeline stages). close() only sets a flag:
+ * a waiting end notices it on its next poll, at most one back-off (200 us)
+ * later. Shutdown is the only user, so there is no condition variable on the
+ * hot path.
+ *
+ */
+
+#ifndef SPSC_QUEUE_H_
+#define SPSC_QUEUE_H_
+
+#include <atomic>
+#include <vector>
+#include <thread>
+#include <unistd.h>
+
+template <typename T>
+class SPSC_Queue
+{
+public:
+
+	explicit SPSC_Queue(size_t capacity) :
+		_size(capacity + 1), _buf(capacity + 1), _head(0), _tail(0), _closed(false) {}
+
+	// producer
+	bool try_push(const T& value)
+	{
+		size_t tail = _tail.load(std::memory_order_relaxed);
+		size_t next = (tail + 1) % _size;
+		if (next == _head.load(std::memory_order_acquire))
+			return false;
+		_buf[tail] = value;
+		_tail.store(next, std::memory_order_release);
+		return true;
+	}
+
+	// 队列满时等待，队列关闭后返回false
+	bool push(const T& value)
+	{
+		for (int spin = 0; !try_push(value); ++spin) {
+			if (closed())
+				return false;
+			backoff(spin);
+		}
+		return true;
+	}
+
+	// consumer
+	bool try_pop(T& value)
+	{
+		size_t head = _head.load(std::memory_order_relaxed);
+		if (head == _tail.load(std::memory_order_acquire))
+			return false;
+		value = _buf[head];
+		_head.store((head + 1) % _size, std::memory_order_release);
+		return true;
+	}
+
+	// 队列空时等待，队列关闭且取空后返回false
+	bool pop(T& value)
+	{
+		for (int spin = 0; ; ++spin) {
+			if (try_pop(value))
+				return true;
+			if (closed())
+				return try_pop(value);
+			backoff(spin);
+		}
+	}
+
+	// 等待中的一端最迟在下一次轮询(200us)时返回
+	void close() { _closed.store(true, std::memory_order_release); }
+	bool closed() const { return _closed.load(std::memory_order_acquire); }
+
+	// occupancy, exact only when called from one of the two ends
+	size_t size() const
+	{
+		size_t head = _head.load(std::memory_order_acquire);
+		size_t tail = _tail.load(std::memory_order_acquire);
+		return (tail + _size - head) % _size;
+	}
+	size_t capacity() const { return _size - 1; }
+
+private:
+
+	static void backoff(int spin)
+	{
+		if (spin < 64)
+			std::this_thread::yield();
+		else
+			usleep(200);
+	}
+
+	const size_t _size;
+	std::vector<T> _buf;
+
+	alignas(64) std::atomic<size_t> _head;
+	alignas(64) std::atomic<size_t> _tail;
+	std::atomic<bool> _closed;
+};
+
+#endif // SPSC_QUEUE_H_
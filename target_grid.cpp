@@ -0,0 +1,274 @@
+/**
+ * @file target_grid.cpp
+ *
+ * @brief Uniform grid over the target list for association
+ *
+ */
+
+#include "target_grid.h"
+#include "autopilot_interface.h"
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+
+// ------------------------------------------------------------------------------
+//   Grid
+// ------------------------------------------------------------------------------
+Target_Grid::
+Target_Grid(float cell_) :
+	cell(cell_ > 0 ? cell_ : 1.f), hashed(false), count(0), indexed(0)
+{
+}
+
+void
+Target_Grid::
+clear()
+{
+	for (auto &c : cells)
+		c.second.clear();
+	hashed = false;
+	live.clear();
+	pos.clear();
+	count = 0;
+	indexed = 0;
+}
+
+void
+Target_Grid::
+rebuild(const vector<target> &targets)
+{
+	clear();
+	for (size_t i = 0; i < targets.size(); i++) {
+		if (targets[i].state != TRACK_DEAD)
+			insert(int(i), targets[i].locx, targets[i].locy);
+	}
+	indexed = targets.size();
+}
+
+void
+Target_Grid::
+insert(int index, float x, float y)
+{
+	if (pos.size() <= size_t(index))
+		pos.resize(index + 1);
+	pos[index] = Point2f(x, y);
+	live.insert(lower_bound(live.begin(), live.end(), index), index);
+	count++;
+	indexed = max(indexed, size_t(index) + 1);
+
+	if (hashed) {
+		cells[key_of(pos[index])].push_back(index);
+	} else if (count >= TARGET_GRID_LINEAR_MAX) {
+		for (int i : live)
+			cells[key_of(pos[i])].push_back(i);
+		hashed = true;
+	}
+}
+
+void
+Target_Grid::
+remove(int index, int64_t k)
+{
+	auto it = cells.find(k);
+	if (it == cells.end())
+		return;
+	vector<int> &c = it->second;
+	for (size_t i = 0; i < c.size(); i++) {
+		if (c[i] == index) {
+			c[i] = c.back();
+			c.pop_back();
+			return;
+		}
+	}
+}
+
+void
+Target_Grid::
+move(int index, float x, float y)
+{
+	Point2f p(x, y);
+	if (hashed) {
+		int64_t k0 = key_of(pos[index]), k1 = key_of(p);
+		if (k0 != k1) {
+			remove(index, k0);
+			cells[k1].push_back(index);
+		}
+	}
+	pos[index] = p;
+}
+
+void
+Target_Grid::
+erase(int index)
+{
+	auto it = lower_bound(live.begin(), live.end(), index);
+	if (it == live.end() || *it != index)
+		return;
+	live.erase(it);
+	if (hashed)
+		remove(index, key_of(pos[index]));
+	count--;
+}
+
+int
+Target_Grid::
+find(const vector<target> &targets, float x, float y, float dis) const
+{
+	// 目标少时按序号逐个比较，第一个符合的即是序号最小的
+	if (!hashed) {
+		for (int i : live) {
+			if (abs(x - targets[i].locx) < dis && abs(y - targets[i].locy) < dis)
+				return i;
+		}
+		return -1;
+	}
+	// dis不大于格子边长时只需查相邻的一圈格子
+	int best = -1;
+	for_each_near(x, y, dis, [&](int i) {
+		const target &t = targets[i];
+		if (abs(x - t.locx) < dis && abs(y - t.locy) < dis && (best < 0 || i < best))
+			best = i;
+	});
+	return best;
+}
+
+// ------------------------------------------------------------------------------
+//   Benchmark
+// ------------------------------------------------------------------------------
+// 原来possible_ellipse中的逐个比较
+static int
+find_linear(const vector<target> &targets, float x, float y, float dis)
+{
+	for (size_t i = 0; i < targets.size(); i++) {
+		if (abs(x - targets[i].locx) < dis && abs(y - targets[i].locy) < dis)
+			return int(i);
+	}
+	return -1;
+}
+
+int
+BenchTargetGrid(int n)
+{
+	if (n <= 0) {
+		printf("usage: mavlink_serial --bench-targets <number of targets>\n");
+		return 1;
+	}
+	const float dis = 5;
+	const int frames = 1000, detections = 20;
+
+	// 目标按约12米间距分布在方形场地上，每帧的检测大多是已有目标附近的观测，少数为新目标
+	mt19937 rng(1);
+	float side = 12.f * sqrt(float(n));
+	uniform_real_distribution<float> field(0.f, side), noise(-1.5f, 1.5f), unit(0.f, 1.f);
+	vector<target> base(n);
+	for (int i = 0; i < n; i++) {
+		base[i].locx = field(rng);
+		base[i].locy = field(rng);
+	}
+	vector<float> det_x, det_y;
+	for (int f = 0; f < frames * detections; f++) {
+		if (unit(rng) < 0.9f) {
+			const target &t = base[rng() % n];
+			det_x.push_back(t.locx + noise(rng));
+			det_y.push_back(t.locy + noise(rng));
+		} else {
+			det_x.push_back(field(rng));
+			det_y.push_back(field(rng));
+		}
+	}
+
+	// 两种方法各自按possible_ellipse的规则更新一份目标列表，逐次核对关联结果
+	vector<target> linear = base, grid_targets = base;
+	Target_Grid grid(dis);
+	grid.rebuild(grid_targets);
+	vector<int> result_linear(det_x.size()), result_grid(det_x.size());
+
+	auto t0 = chrono::steady_clock::now();
+	for (size_t d = 0; d < det_x.size(); d++) {
+		int i = find_linear(linear, det_x[d], det_y[d], dis);
+		if (i >= 0) {
+			linear[i].locx = det_x[d];
+			linear[i].locy = det_y[d];
+		} else {
+			target t;
+			t.locx = det_x[d];
+			t.locy = det_y[d];
+			linear.push_back(t);
+		}
+		result_linear[d] = i;
+	}
+	auto t1 = chrono::steady_clock::now();
+	for (size_t d = 0; d < det_x.size(); d++) {
+		int i = grid.find(grid_targets, det_x[d], det_y[d], dis);
+		if (i >= 0) {
+			target &t = grid_targets[i];
+			grid.move(i, det_x[d], det_y[d]);
+			t.locx = det_x[d];
+			t.locy = det_y[d];
+		} else {
+			target t;
+			t.locx = det_x[d];
+			t.locy = det_y[d];
+			grid.insert(int(grid_targets.size()), t.locx, t.locy);
+			grid_targets.push_back(t);
+		}
+		result_grid[d] = i;
+	}
+	auto t2 = chrono::steady_clock::now();
+
+	// Target_Tracker::associate要比较门限内的每个目标，不能在第一个符合的目标处停下
+	size_t hits_linear = 0, hits_grid = 0;
+	for (size_t d = 0; d < det_x.size(); d++) {
+		for (size_t i = 0; i < linear.size(); i++)
+			hits_linear += abs(det_x[d] - linear[i].locx) < dis && abs(det_y[d] - linear[i].locy) < dis;
+	}
+	auto t2a = chrono::steady_clock::now();
+	for (size_t d = 0; d < det_x.size(); d++) {
+		grid.for_each_near(det_x[d], det_y[d], dis, [&](int i) {
+			hits_grid += abs(det_x[d] - grid_targets[i].locx) < dis && abs(det_y[d] - grid_targets[i].locy) < dis;
+		});
+	}
+	auto t2b = chrono::steady_clock::now();
+
+	// 目标顺序：原来nearellipse每帧对整个列表冒泡排序，现在按编号引用，只在需要时选出最近的k个
+	const int sort_frames = 20;
+	float px = side / 2, py = side / 2;
+	vector<target> sorted = grid_targets;
+	auto t3 = chrono::steady_clock::now();
+	for (int f = 0; f < sort_frames; f++) {
+		int size = int(sorted.size());
+		for (int i = 0; i < size - 1; i++) {
+			for (int j = 0; j < size - i - 1; j++) {
+				if (ellipsedistance(px, py, sorted[j].locx, sorted[j].locy) >
+				    ellipsedistance(px, py, sorted[j + 1].locx, sorted[j + 1].locy))
+					swap(sorted[j], sorted[j + 1]);
+			}
+		}
+		px += 1.f;
+	}
+	auto t4 = chrono::steady_clock::now();
+	vector<int> nearest;
+	for (int f = 0; f < sort_frames; f++)
+		nearest_targets(grid_targets, px - f, py, 5, nearest);
+	auto t5 = chrono::steady_clock::now();
+
+	size_t mismatches = 0;
+	for (size_t d = 0; d < det_x.size(); d++)
+		mismatches += result_linear[d] != result_grid[d];
+	double us_linear = chrono::duration<double, micro>(t1 - t0).count();
+	double us_grid = chrono::duration<double, micro>(t2 - t1).count();
+	printf("targets %d -> %u, %d frames x %d detections, field %.0f m\n", n, (unsigned)linear.size(),
+	       frames, detections, side);
+	printf("  linear: %.2f us/frame\n", us_linear / frames);
+	printf("  grid:   %.2f us/frame (%.1fx, no cells below %d targets)\n", us_grid / frames,
+	       us_grid > 0 ? us_linear / us_grid : 0., TARGET_GRID_LINEAR_MAX);
+	printf("  mismatches: %u\n", (unsigned)mismatches);
+	printf("  every match (associate): linear %.2f us/frame, grid %.2f us/frame%s\n",
+	       chrono::duration<double, micro>(t2a - t2).count() / frames,
+	       chrono::duration<double, micro>(t2b - t2a).count() / frames, hits_linear == hits_grid ? "" : " MISMATCH");
+	printf("  ordering: bubble sort %.1f us/frame, 5 nearest %.1f us/call\n",
+	       chrono::duration<double, micro>(t4 - t3).count() / sort_frames,
+	       chrono::duration<double, micro>(t5 - t4).count() / sort_frames);
+	return mismatches || hits_linear != hits_grid ? 1 : 0;
+}
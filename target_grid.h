@@ -0,0 +1,105 @@
+/**
+ * @file target_grid.h
+ *
+ * @brief Uniform grid over the target list for association
+ *
+ * possible_ellipse() and associate_targets() look for a stored target within
+ * `dis` metres (in x and in y) of every detection. Scanning the whole
+ * target_ellipse_position per detection costs O(detections x targets). The
+ * grid hashes every target by its local NED cell (cell size = association
+ * radius) and only the 3x3 neighbouring cells are searched, so a lookup is
+ * O(1) on average. Among the matches the smallest index is returned, which is
+ * the target the linear scan found first.
+ *
+ * With few targets the hashing costs more than it saves (--bench-targets,
+ * 10 targets: grid 6.7 us, linear 1.1 us per frame; when every match has to
+ * be visited, as in Target_Tracker::associate, the grid only wins from
+ * roughly 150 targets on). Below TARGET_GRID_LINEAR_MAX targets no cells are
+ * kept and the queries scan the stored targets in index order. The cells are
+ * built when the count reaches it and kept until the next clear()/rebuild().
+ *
+ * The grid stores indices into the target vector: after the vector is
+ * reordered it has to be rebuilt, after a target moved, move() it. Deleted
+ * tracks (TRACK_DEAD) are not in the grid.
+ *
+ */
+
+#ifndef TARGET_GRID_H_
+#define TARGET_GRID_H_
+
+#include <unordered_map>
+#include <vector>
+
+#include "ellipse/EllipseDetectorYaed.h"
+
+#define TARGET_GRID_LINEAR_MAX 128             // 目标数少于此值时逐个比较，不建格子
+
+class Target_Grid
+{
+public:
+
+	// cell: 格子边长 m，取关联距离
+	explicit Target_Grid(float cell_ = 5.f);
+
+	void clear();
+	void rebuild(const vector<target> &targets);
+
+	void insert(int index, float x, float y);
+	// 目标移到(x, y)，index须在网格中
+	void move(int index, float x, float y);
+
+	// x、y方向都相距小于dis的目标中序号最小的一个，没有时返回-1
+	int find(const vector<target> &targets, float x, float y, float dis) const;
+
+	// 对(x, y)周围dis以内格子中的每个目标序号调用f(index)，由调用方再做精确判断；
+	// 还没建格子时对每个目标调用
+	template <class F>
+	void for_each_near(float x, float y, float dis, F f) const
+	{
+		if (!hashed) {
+			for (int i : live)
+				f(i);
+			return;
+		}
+		int r = max(int(ceil(dis / cell)), 1);
+		int ix = cell_of(x), iy = cell_of(y);
+		for (int cx = ix - r; cx <= ix + r; cx++) {
+			for (int cy = iy - r; cy <= iy + r; cy++) {
+				auto it = cells.find(key(cx, cy));
+				if (it == cells.end())
+					continue;
+				for (int i : it->second)
+					f(i);
+			}
+		}
+	}
+
+	// 删除的目标移出网格
+	void erase(int index);
+
+	size_t size() const { return count; }
+	// 网格对应的目标列表长度(含已删除的目标)，与列表不一致时需要rebuild
+	size_t get_indexed() const { return indexed; }
+	float get_cell() const { return cell; }
+
+private:
+
+	int cell_of(float v) const { return int(floor(v / cell)); }
+	static int64_t key(int ix, int iy) { return int64_t((uint64_t(uint32_t(ix)) << 32) | uint32_t(iy)); }
+	int64_t key_of(const Point2f &p) const { return key(cell_of(p.x), cell_of(p.y)); }
+	void remove(int index, int64_t k);
+
+	float cell;
+	// 空的格子保留，目标来回移动时不反复分配
+	unordered_map<int64_t, vector<int> > cells;
+	bool hashed;                                // cells是否已建立
+	vector<int> live;                           // 网格中的目标序号，由小到大
+	vector<Point2f> pos;                        // 按目标序号记录加入网格时和move后的位置
+	size_t count;
+	size_t indexed;
+};
+
+// --bench-targets：比较逐个比较与网格两种关联的耗时并核对结果一致，另外比较整表冒泡排序与选出最近k个的耗时
+int BenchTargetGrid(int targets);
+
+#endif // TARGET_GRID_H_
@@ -0,0 +1,238 @@
+/**
+ * @file target_tracker.cpp
+ *
+ * @brief Kalman filtered target tracks with a Bayesian T/F belief
+ *
+ */
+
+#include "target_tracker.h"
+
+// ------------------------------------------------------------------------------
+//   Parameters
+// ------------------------------------------------------------------------------
+Tracker_Params::
+Tracker_Params() :
+	sigma_px(2.f), sigma_nav(1.f), process_noise(0.01f), gate(9.21f), max_distance(5.f),
+	confirm_hits(3), tentative_s(2.f), p_flag(0.75f), p_vote(0.8f), max_llr(3.f), decide_logodds(6.9f),
+	min_recognitions(10)
+{
+}
+
+void
+Tracker_Params::
+Read(const FileNode &node)
+{
+	if (node.empty())
+		return;
+	if (!node["sigma_px"].empty())
+		sigma_px = max((float)node["sigma_px"], 0.f);
+	if (!node["sigma_nav"].empty())
+		sigma_nav = max((float)node["sigma_nav"], 0.f);
+	if (!node["process_noise"].empty())
+		process_noise = max((float)node["process_noise"], 0.f);
+	if (!node["gate"].empty())
+		gate = max((float)node["gate"], 0.f);
+	if (!node["max_distance"].empty())
+		max_distance = max((float)node["max_distance"], 0.f);
+	if (!node["confirm_hits"].empty())
+		confirm_hits = max((int)node["confirm_hits"], 1);
+	if (!node["tentative_s"].empty())
+		tentative_s = max((float)node["tentative_s"], 0.f);
+	// 概率为0.5时观测不提供信息，不能低于0.5
+	if (!node["p_flag"].empty())
+		p_flag = min(max((float)node["p_flag"], 0.5f), 0.999f);
+	if (!node["p_vote"].empty())
+		p_vote = min(max((float)node["p_vote"], 0.5f), 0.999f);
+	if (!node["max_llr"].empty())
+		max_llr = max((float)node["max_llr"], 0.f);
+	if (!node["decide_logodds"].empty())
+		decide_logodds = max((float)node["decide_logodds"], 0.f);
+	if (!node["min_recognitions"].empty())
+		min_recognitions = max((int)node["min_recognitions"], 1);
+}
+
+// ------------------------------------------------------------------------------
+//   Tracker
+// ------------------------------------------------------------------------------
+static float
+logit(float p)
+{
+	p = min(max(p, 0.001f), 0.999f);
+	return log(p / (1 - p));
+}
+
+Target_Tracker::
+Target_Tracker(const Tracker_Params &params_) :
+	params(params_), births(0), confirms(0), deaths(0)
+{
+}
+
+float
+Target_Tracker::
+measurement_var(float h) const
+{
+	// 像素误差按相似三角形换算到地面，高度未知时只计导航误差
+	float px = h > 0 ? params.sigma_px * h / fx : 0.f;
+	return params.sigma_nav * params.sigma_nav + px * px;
+}
+
+void
+Target_Tracker::
+predict(const target &t, uint64_t t_us, float &xx, float &xy, float &yy) const
+{
+	float dt = (t_us > t.last_us) ? (t_us - t.last_us) * 1e-6f : 0.f;
+	xx = t.var_xx + params.process_noise * dt;
+	xy = t.var_xy;
+	yy = t.var_yy + params.process_noise * dt;
+}
+
+int
+Target_Tracker::
+associate(const vector<target> &targets, const Target_Grid &grid, float x, float y, float h, uint64_t t_us) const
+{
+	float r = measurement_var(h);
+	float dis = params.max_distance;
+	int best = -1;
+	float best_d2 = params.gate;
+	grid.for_each_near(x, y, dis, [&](int i) {
+		const target &t = targets[i];
+		float dx = x - t.locx, dy = y - t.locy;
+		if (abs(dx) >= dis || abs(dy) >= dis)
+			return;
+		// 新息协方差S = P + R，d² = νᵀS⁻¹ν
+		float xx, xy, yy;
+		predict(t, t_us, xx, xy, yy);
+		float sxx = xx + r, syy = yy + r;
+		float det = sxx * syy - xy * xy;
+		if (det <= 0)
+			return;
+		float d2 = (syy * dx * dx - 2 * xy * dx * dy + sxx * dy * dy) / det;
+		// 距离相同时取编号小的，与网格中的顺序无关
+		if (d2 < best_d2 || (d2 == best_d2 && best >= 0 && i < best)) {
+			best_d2 = d2;
+			best = i;
+		}
+	});
+	return best;
+}
+
+float
+Target_Tracker::
+observation_llr(const coordinate &p) const
+{
+	float llr;
+	if (p.cached)
+		llr = 0;// 识别缓存沿用的结果不是新的观测
+	else if (p.probT >= 0)
+		llr = logit(p.probT);
+	else if (p.votesT + p.votesF > 0)
+		llr = (p.flag == 1 ? 1.f : (p.flag == 0 ? -1.f : 0.f)) * p.conf * logit(params.p_vote);// 多阈值：一帧一次观测，按一致程度加权
+	else if (p.flag == 1)
+		llr = logit(params.p_flag);
+	else if (p.flag == 0)
+		llr = -logit(params.p_flag);
+	else
+		llr = 0;// 未识别
+	return min(max(llr, -params.max_llr), params.max_llr);
+}
+
+void
+Target_Tracker::
+correct(vector<target> &targets, Target_Grid &grid, int id, const coordinate &p, float h, uint64_t t_us)
+{
+	target &t = targets[id];
+	float r = measurement_var(h);
+	float xx, xy, yy;
+	predict(t, t_us, xx, xy, yy);
+
+	// K = P(P + R)⁻¹，R = rI
+	float sxx = xx + r, syy = yy + r;
+	float det = sxx * syy - xy * xy;
+	if (det > 0) {
+		float ixx = syy / det, ixy = -xy / det, iyy = sxx / det;
+		float kxx = xx * ixx + xy * ixy, kxy = xx * ixy + xy * iyy;
+		float kyx = xy * ixx + yy * ixy, kyy = xy * ixy + yy * iyy;
+		float dx = p.locx - t.locx, dy = p.locy - t.locy;
+		float x = t.locx + kxx * dx + kxy * dy;
+		float y = t.locy + kyx * dx + kyy * dy;
+		grid.move(id, x, y);
+		t.locx = x;
+		t.locy = y;
+		// P = (I - K)P
+		t.var_xx = (1 - kxx) * xx - kxy * xy;
+		t.var_xy = (1 - kxx) * xy - kxy * yy;
+		t.var_yy = -kyx * xy + (1 - kyy) * yy;
+	}
+	observe(t, p, t_us);
+}
+
+void
+Target_Tracker::
+observe(target &t, const coordinate &p, uint64_t t_us)
+{
+	t.last_us = max(t.last_us, t_us);
+	if (t.hits < UINT16_MAX)
+		t.hits++;
+	if (t.state == TRACK_TENTATIVE && t.hits >= params.confirm_hits) {
+		t.state = TRACK_CONFIRMED;
+		confirms++;
+	}
+
+	// T/F的后验：对数几率累加每次观测的对数似然比，T_N/F_N每帧按flag只记一次
+	// 识别缓存沿用的结果只更新位置
+	if (p.cached)
+		return;
+	if ((p.flag == 0 || p.flag == 1) && t.recognitions < UINT16_MAX)
+		t.recognitions++;
+	t.logodds += observation_llr(p);
+	t.possbile = 1.f / (1.f + exp(-t.logodds));
+	if (p.flag == 1)
+		t.T_N++;
+	else if (p.flag == 0)
+		t.F_N++;
+}
+
+int
+Target_Tracker::
+birth(vector<target> &targets, Target_Grid &grid, const coordinate &p, float h, uint64_t t_us)
+{
+	target t;
+	t.locx = p.locx;
+	t.locy = p.locy;
+	t.var_xx = t.var_yy = measurement_var(h);
+	t.last_us = t_us;
+	t.possbile = 0.5f;// logodds为0，还没有T/F观测
+	//目标只在末尾添加、不重新排序，序号即编号，任务流程按编号引用目标
+	t.num = int(targets.size());
+	grid.insert(t.num, t.locx, t.locy);
+	targets.push_back(t);
+	births++;
+	tentative.push_back(t.num);
+	// 第一次观测的T/F结果同样计入，confirm_hits为1时直接确认
+	observe(targets.back(), p, t_us);
+	return t.num;
+}
+
+void
+Target_Tracker::
+prune(vector<target> &targets, Target_Grid &grid, uint64_t t_us)
+{
+	uint64_t timeout = uint64_t(params.tentative_s * 1e6);
+	size_t n = 0;
+	for (size_t k = 0; k < tentative.size(); k++) {
+		int id = tentative[k];
+		if (id >= int(targets.size()))
+			continue;
+		target &t = targets[id];
+		if (t.state != TRACK_TENTATIVE)
+			continue;
+		if (t_us > t.last_us + timeout) {
+			t.state = TRACK_DEAD;
+			grid.erase(id);
+			deaths++;
+			continue;
+		}
+		tentative[n++] = id;
+	}
+	tentative.resize(n);
+}
@@ -0,0 +1,118 @@
+/**
+ * @file target_tracker.h
+ *
+ * @brief Kalman filtered target tracks with a Bayesian T/F belief
+ *
+ * possible_ellipse() used to snap a target to the latest detection within
+ * 5 m, and resultTF() only decided T/F after more than 50 votes with a vote
+ * ratio above 0.4. Every detection weighed the same regardless of altitude,
+ * a single false detection created a target for the rest of the flight and
+ * the decision needed ~50 frames however clear the recognition was.
+ *
+ * Each target is now a track in local NED coordinates:
+ *  - position: constant position Kalman filter (the targets do not move).
+ *    The measurement variance grows with the height, pixel noise sigma_px at
+ *    focal length fx plus the navigation error sigma_nav; process noise
+ *    (m^2/s) absorbs drift of the local position;
+ *  - association: the grid candidates within max_distance, gated by the
+ *    Mahalanobis distance of the innovation (chi^2, 2 dof), nearest wins;
+ *  - birth / death: an unassociated detection starts a tentative track, which
+ *    is confirmed after confirm_hits observations and deleted (TRACK_DEAD)
+ *    when it is not seen again within tentative_s. Confirmed tracks are kept.
+ *    Deleted tracks stay in the list so that the index remains the target id;
+ *  - T/F belief: every observation adds its log likelihood ratio to
+ *    target::logodds (classifier probability, threshold votes or the T/F
+ *    flag, each clamped to +-max_llr; one observation per frame, the ensemble
+ *    weighted by its agreement conf); possbile is the posterior P(T). A
+ *    confirmed track is decided once |logodds| exceeds decide_logodds and it
+ *    has at least min_recognitions fresh recognitions.
+ *
+ * Results served by the recognition cache are position-only observations.
+ * Fresh recognitions of a hovering, static target are still correlated, so
+ * the update treats them as independent only as an approximation: p_flag and
+ * p_vote stay below the real accuracy of the recognizer, and min_recognitions
+ * keeps a few misreads from deciding a target before the throw.
+ *
+ * The tracker and the target list are updated by the classify stage under
+ * target_mutex; the mission thread reads decisions through target_decision().
+ *
+ */
+
+#ifndef TARGET_TRACKER_H_
+#define TARGET_TRACKER_H_
+
+#include <atomic>
+
+#include "target_grid.h"
+
+// vision.yml中tracker一节
+struct Tracker_Params
+{
+	float sigma_px;                         // 640*360图中圆心的测量误差 像素
+	float sigma_nav;                        // 本地位置与姿态带来的误差 m
+	float process_noise;                    // 位置估计每秒增加的方差 m²/s
+	float gate;                             // 马氏距离平方的门限(卡方分布，2自由度)
+	float max_distance;                     // 关联的最大距离 m(x、y方向)，不大于网格边长
+	int confirm_hits;                       // 确认目标需要的观测次数
+	float tentative_s;                      // 暂定目标超过该时间未观测到则删除 s
+	float p_flag;                           // 单次T/F识别结果正确的概率
+	float p_vote;                           // 多阈值识别各阈值一致(conf为1)时一帧结果正确的概率
+	float max_llr;                          // 单次观测对数似然比的上限
+	float decide_logodds;                   // |logodds|超过该值即判定T或F
+	int min_recognitions;                   // 判定前至少需要的新识别次数
+
+	Tracker_Params();
+
+	// 缺省的项保留默认值
+	void Read(const FileNode &node);
+};
+
+class Target_Tracker
+{
+public:
+
+	explicit Target_Tracker(const Tracker_Params &params_ = Tracker_Params());
+
+	void set_params(const Tracker_Params &params_) { params = params_; }
+	const Tracker_Params &get_params() const { return params; }
+
+	// 高度h(m)时一次观测的位置方差 m²
+	float measurement_var(float h) const;
+
+	// 与观测(x, y)关联的目标序号：门限内马氏距离最小的，没有时返回-1
+	int associate(const vector<target> &targets, const Target_Grid &grid, float x, float y, float h, uint64_t t_us) const;
+	// 用观测p(locx、locy为观测位置)更新目标id的位置和T/F概率
+	void correct(vector<target> &targets, Target_Grid &grid, int id, const coordinate &p, float h, uint64_t t_us);
+	// 新建暂定目标，返回编号
+	int birth(vector<target> &targets, Target_Grid &grid, const coordinate &p, float h, uint64_t t_us);
+	// 删除超时的暂定目标
+	void prune(vector<target> &targets, Target_Grid &grid, uint64_t t_us);
+
+	bool decided_T(const target &t) const { return decidable(t) && t.logodds > params.decide_logodds; }
+	bool decided_F(const target &t) const { return decidable(t) && t.logodds < -params.decide_logodds; }
+
+	uint64_t get_births() const { return births; }
+	uint64_t get_confirms() const { return confirms; }
+	uint64_t get_deaths() const { return deaths; }
+
+private:
+
+	bool decidable(const target &t) const
+	{
+		return t.state == TRACK_CONFIRMED && t.recognitions >= params.min_recognitions;
+	}
+	// 一次观测的对数似然比 log P(z|T)/P(z|F)
+	float observation_llr(const coordinate &p) const;
+	// 记录一次观测：计数、确认、T/F后验
+	void observe(target &t, const coordinate &p, uint64_t t_us);
+	// 距上次观测dt秒后的预测方差
+	void predict(const target &t, uint64_t t_us, float &xx, float &xy, float &yy) const;
+
+	Tracker_Params params;
+	vector<int> tentative;                  // 暂定目标的编号，prune只检查这些
+	std::atomic<uint64_t> births;
+	std::atomic<uint64_t> confirms;
+	std::atomic<uint64_t> deaths;
+};
+
+#endif // TARGET_TRACKER_H_
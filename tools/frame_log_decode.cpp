@@ -0,0 +1,139 @@
+/**
+ * @file frame_log_decode.cpp
+ *
+ * @brief Print or export the binary per-frame log written by the vision sink
+ *
+ * usage: frame_log_decode <frames.flog> [--csv] [--last N]
+ *
+ * Without --csv every record is printed as a short block, like the old
+ * target_r.txt. With --csv one row per target (or one row with empty target
+ * columns for frames without targets) is written to stdout.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "frame_log.h"
+
+static const char *kind_name[] = { "target", "T", "F" };
+static const char *state_name[] = { "tentative", "confirmed", "dead" };
+
+static void
+print_record(const Frame_Log_Record &r)
+{
+	printf("frame %llu stamp_us %llu time_usec %llu\n",
+	       (unsigned long long)r.frame_id, (unsigned long long)r.stamp_us, (unsigned long long)r.time_usec);
+	printf("  stage ms preprocess %.1f detect %.1f classify %.1f update %.1f sink %.1f  setpoint frame %llu latency %.1f ms\n",
+	       r.preprocess_us / 1000., r.detect_us / 1000., r.classify_us / 1000., r.update_us / 1000., r.sink_us / 1000.,
+	       (unsigned long long)r.setpoint_frame_id, r.setpoint_latency_us / 1000.);
+	printf("  local_position %.3f %.3f %.3f  getlocalposition:%d stable:%d drop:%d updateellipse:%d target_Num:%d\n",
+	       r.local_x, r.local_y, r.local_z,
+	       (r.flags & FRAME_LOG_LOCAL_POSITION) != 0, (r.flags & FRAME_LOG_STABLE) != 0,
+	       (r.flags & FRAME_LOG_DROP) != 0, (r.flags & FRAME_LOG_UPDATE_ELLIPSE) != 0, r.target_num);
+	printf("  target_ellipse.size = %d ellipse_T.size = %d ellipse_F.size = %d\n",
+	       r.n_total[FRAME_LOG_TARGET], r.n_total[FRAME_LOG_T], r.n_total[FRAME_LOG_F]);
+	for (int i = 0; i < r.n_targets && i < FRAME_LOG_MAX_TARGETS; i++) {
+		const Frame_Log_Target &t = r.targets[i];
+		printf("  %-6s x = %.3f y = %.3f T = %d F = %d possible = %.3f logodds = %.2f lat:%d lon:%d No.:%d %s\n",
+		       kind_name[t.kind < 3 ? t.kind : 0], t.locx, t.locy, t.T_N, t.F_N, t.possible, t.logodds,
+		       t.lat, t.lon, t.num, state_name[t.state >= 0 && t.state < 3 ? t.state : 0]);
+	}
+}
+
+static void
+print_csv_header()
+{
+	printf("frame_id,stamp_us,time_usec,preprocess_us,detect_us,classify_us,update_us,sink_us,"
+	       "setpoint_frame_id,setpoint_latency_us,local_x,local_y,local_z,getlocalposition,stable,drop,updateellipse,target_num,"
+	       "n_target,n_T,n_F,kind,locx,locy,T_N,F_N,possible,logodds,lat,lon,num,state\n");
+}
+
+static void
+print_csv(const Frame_Log_Record &r)
+{
+	char prefix[256];
+	snprintf(prefix, sizeof(prefix), "%llu,%llu,%llu,%u,%u,%u,%u,%u,%llu,%u,%.3f,%.3f,%.3f,%d,%d,%d,%d,%d,%d,%d,%d",
+	         (unsigned long long)r.frame_id, (unsigned long long)r.stamp_us, (unsigned long long)r.time_usec,
+	         r.preprocess_us, r.detect_us, r.classify_us, r.update_us, r.sink_us,
+	         (unsigned long long)r.setpoint_frame_id, r.setpoint_latency_us,
+	         r.local_x, r.local_y, r.local_z,
+	         (r.flags & FRAME_LOG_LOCAL_POSITION) != 0, (r.flags & FRAME_LOG_STABLE) != 0,
+	         (r.flags & FRAME_LOG_DROP) != 0, (r.flags & FRAME_LOG_UPDATE_ELLIPSE) != 0, r.target_num,
+	         r.n_total[FRAME_LOG_TARGET], r.n_total[FRAME_LOG_T], r.n_total[FRAME_LOG_F]);
+	if (r.n_targets == 0) {
+		printf("%s,,,,,,,,,,,\n", prefix);
+		return;
+	}
+	for (int i = 0; i < r.n_targets && i < FRAME_LOG_MAX_TARGETS; i++) {
+		const Frame_Log_Target &t = r.targets[i];
+		printf("%s,%s,%.3f,%.3f,%d,%d,%.3f,%.3f,%d,%d,%d,%s\n", prefix, kind_name[t.kind < 3 ? t.kind : 0],
+		       t.locx, t.locy, t.T_N, t.F_N, t.possible, t.logodds, t.lat, t.lon, t.num,
+		       state_name[t.state >= 0 && t.state < 3 ? t.state : 0]);
+	}
+}
+
+int
+main(int argc, char **argv)
+{
+	const char *file = NULL;
+	bool csv = false;
+	unsigned long long last = 0;
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--csv") == 0)
+			csv = true;
+		else if (strcmp(argv[i], "--last") == 0 && i + 1 < argc)
+			last = strtoull(argv[++i], NULL, 10);
+		else
+			file = argv[i];
+	}
+	if (file == NULL) {
+		fprintf(stderr, "usage: %s <frames.flog> [--csv] [--last N]\n", argv[0]);
+		return 1;
+	}
+
+	FILE *fp = fopen(file, "rb");
+	if (fp == NULL) {
+		fprintf(stderr, "could not open %s\n", file);
+		return 1;
+	}
+	Frame_Log_Header header;
+	if (fread(&header, sizeof(header), 1, fp) != 1 || header.magic != FRAME_LOG_MAGIC) {
+		fprintf(stderr, "%s is not a frame log\n", file);
+		fclose(fp);
+		return 1;
+	}
+	if (header.version != FRAME_LOG_VERSION || header.record_size != sizeof(Frame_Log_Record)) {
+		fprintf(stderr, "%s: version %u record size %u, this decoder reads version %d record size %u\n",
+		        file, header.version, header.record_size, FRAME_LOG_VERSION, (unsigned)sizeof(Frame_Log_Record));
+		fclose(fp);
+		return 1;
+	}
+
+	// 环形文件中只保留最近capacity条
+	uint64_t first = header.count > header.capacity ? header.count - header.capacity : 0;
+	if (last && header.count - first > last)
+		first = header.count - last;
+	if (!csv)
+		printf("%s: %llu records written, %llu kept, start_usec %llu\n", file,
+		       (unsigned long long)header.count, (unsigned long long)(header.count - first),
+		       (unsigned long long)header.start_usec);
+	else
+		print_csv_header();
+
+	Frame_Log_Record record;
+	for (uint64_t n = first; n < header.count; n++) {
+		long offset = sizeof(Frame_Log_Header) + (n % header.capacity) * sizeof(Frame_Log_Record);
+		if (fseek(fp, offset, SEEK_SET) != 0 || fread(&record, sizeof(record), 1, fp) != 1) {
+			fprintf(stderr, "%s: truncated at record %llu\n", file, (unsigned long long)n);
+			break;
+		}
+		if (csv)
+			print_csv(record);
+		else
+			print_record(record);
+	}
+	fclose(fp);
+	return 0;
+}
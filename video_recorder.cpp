@@ -0,0 +1,155 @@
+/**
+ * @file video_recorder.cpp
+ *
+ * @brief Video recording on a dedicated encoder thread
+ *
+ */
+
+#include "video_recorder.h"
+
+// ------------------------------------------------------------------------------
+//   Params
+// ------------------------------------------------------------------------------
+void
+Record_Params::
+Read(const FileNode &node)
+{
+	if (node.empty())
+		return;
+	if (!node["overlay"].empty())
+		overlay = (int)node["overlay"] != 0;
+	if (!node["slots"].empty())
+		slots = max((int)node["slots"], 1);
+	if (!node["drop"].empty())
+		block = (string)node["drop"] == "block";
+	if (!node["fps"].empty())
+		fps = (double)node["fps"];
+	if (!node["raw_every"].empty())
+		raw_every = max((int)node["raw_every"], 0);
+	if (!node["raw_scale"].empty())
+		raw_scale = min(max((double)node["raw_scale"], 0.05), 1.0);
+}
+
+// ------------------------------------------------------------------------------
+//   Con/De structors
+// ------------------------------------------------------------------------------
+Video_Recorder::
+Video_Recorder(size_t slots, bool block_) :
+	block(block_), items(max(slots, size_t(1))), q_free(items.size()), q_encode(items.size()), encode_us(0), producer(std::thread::id())
+{
+	for (size_t i = 0; i < items.size(); i++)
+		q_free.try_push(&items[i]);
+}
+
+Video_Recorder::
+~Video_Recorder()
+{
+	stop();
+}
+
+// ------------------------------------------------------------------------------
+//   Open / Start / Stop
+// ------------------------------------------------------------------------------
+bool
+Video_Recorder::
+open(int stream, const string &file, double fps, Size size)
+{
+	Stream &s = streams[stream];
+	s.size = size;
+	if (!s.writer.open(file, CV_FOURCC('M', 'J', 'P', 'G'), fps, size)) {
+		printf("WARNING: could not open %s for recording\n", file.c_str());
+		return false;
+	}
+	s.index.open((file + ".idx").c_str());
+	s.index << "# video_frame,frame_id,stamp_us,time_usec,stable,drop,local_x,local_y,local_z,ellipses(x y flag;...)" << endl;
+	return true;
+}
+
+void
+Video_Recorder::
+start()
+{
+	thread_encode = std::thread(&Video_Recorder::encode_thread, this);
+}
+
+void
+Video_Recorder::
+stop()
+{
+	q_encode.close();
+	if (thread_encode.joinable())
+		thread_encode.join();
+	for (int i = 0; i < RECORD_STREAM_NUM; i++) {
+		streams[i].writer.release();
+		if (streams[i].index.is_open())
+			streams[i].index.close();
+	}
+}
+
+// ------------------------------------------------------------------------------
+//   Producer
+// ------------------------------------------------------------------------------
+bool
+Video_Recorder::
+submit(int stream, const Mat3b &image, uint64_t frame_id, uint64_t stamp_us, const string &meta)
+{
+	Stream &s = streams[stream];
+	if (!s.writer.isOpened() || image.empty())
+		return false;
+
+	// q_free/q_encode只支持一个生产者，其他线程提交的帧丢弃
+	std::thread::id first, self = std::this_thread::get_id();
+	if (!producer.compare_exchange_strong(first, self) && first != self) {
+		static std::atomic<bool> warned(false);
+		if (!warned.exchange(true))
+			printf("WARNING: Video_Recorder::submit called from a second thread, dropping its frames\n");
+		s.dropped++;
+		return false;
+	}
+
+	Item *item = NULL;
+	bool got = block ? q_free.pop(item) : q_free.try_pop(item);
+	if (!got) {
+		s.dropped++;
+		return false;
+	}
+
+	// 槽内图像尺寸不变，copyTo/resize复用缓冲区
+	if (image.size() == s.size)
+		image.copyTo(item->image);
+	else
+		resize(image, item->image, s.size, 0, 0, CV_INTER_AREA);
+	item->stream = stream;
+	item->frame_id = frame_id;
+	item->stamp_us = stamp_us;
+	item->time_usec = stamp_us + get_time_usec() - get_monotonic_usec();  // 采集时刻换算到系统时钟
+	item->meta = meta;
+
+	if (!q_encode.push(item)) {
+		s.dropped++;
+		return false;
+	}
+	return true;
+}
+
+// ------------------------------------------------------------------------------
+//   Encoder thread
+// ------------------------------------------------------------------------------
+void
+Video_Recorder::
+encode_thread()
+{
+	Item *item;
+	while (q_encode.pop(item)) {
+		uint64_t t0 = get_time_usec();
+		Stream &s = streams[item->stream];
+		s.writer.write(item->image);
+		s.index << s.written << "," << item->frame_id << "," << item->stamp_us << "," << item->time_usec << "," << item->meta << "\n";
+		s.written++;
+		// 编码线程追上时把索引交给系统，进程崩溃时只丢失仍在队列中的帧
+		if (q_encode.size() == 0)
+			s.index.flush();
+		encode_us += get_time_usec() - t0;
+		q_free.push(item);
+	}
+}
@@ -0,0 +1,120 @@
+/**
+ * @file video_recorder.h
+ *
+ * @brief Video recording on a dedicated encoder thread
+ *
+ * The sink copies a frame into one of a fixed number of preallocated slots
+ * and returns; MJPEG encoding and the disk writes happen on the encoder
+ * thread. When every slot is waiting for the encoder (e.g. the SD card
+ * stalls) the frame is dropped, or the sink waits if the drop policy is
+ * "block". Each video gets a sidecar index "<file>.idx" with one line per
+ * written frame: video frame number, pipeline frame id, capture timestamp
+ * (monotonic and system clock) and the detection metadata passed in by the
+ * caller. --replay uses the system clock column to line the video up with
+ * the telemetry log. The index is flushed whenever the encoder has caught up,
+ * so a crash of the process loses at most the frames still queued.
+ *
+ * The slot queues are single-producer: submit() must always be called from
+ * the same thread (the pipeline sink). Frames submitted from any other thread
+ * are dropped with a warning.
+ *
+ */
+
+#ifndef VIDEO_RECORDER_H_
+#define VIDEO_RECORDER_H_
+
+#include <thread>
+#include <atomic>
+#include <string>
+#include <fstream>
+
+#include "autopilot_interface.h"
+#include "spsc_queue.h"
+
+enum {
+	RECORD_OVERLAY = 0,                     // 绘制了检测结果的小图
+	RECORD_RAW,                             // 降频保存的原图
+	RECORD_STREAM_NUM
+};
+
+// vision.yml中recording一节
+struct Record_Params
+{
+	bool overlay;                           // 绘制检测结果并录制小图
+	int slots;
+	bool block;
+	double fps;                             // 小图视频的标称帧率
+	int raw_every;                          // 每隔多少帧录一帧原图，0为不录
+	double raw_scale;                       // 原图缩放比例
+
+	Record_Params() : overlay(true), slots(8), block(false), fps(5.0), raw_every(0), raw_scale(0.5) {}
+
+	// 缺省的项保留默认值
+	void Read(const FileNode &node);
+};
+
+class Video_Recorder
+{
+public:
+
+	// slots: 等待编码的帧数上限；block: 没有空闲槽时等待而不是丢帧
+	Video_Recorder(size_t slots, bool block_);
+	~Video_Recorder();
+
+	// 打开一路视频及其索引文件，图像尺寸与size不同时入队前缩放
+	bool open(int stream, const string &file, double fps, Size size);
+
+	void start();
+	// 编码完已入队的帧后关闭文件
+	void stop();
+
+	// 只由一个线程调用(第一次调用的线程)；拷贝图像后立即返回，返回false表示该帧被丢弃
+	bool submit(int stream, const Mat3b &image, uint64_t frame_id, uint64_t stamp_us, const string &meta);
+
+	bool is_open(int stream) const { return streams[stream].writer.isOpened(); }
+
+	uint64_t get_written(int stream) const { return streams[stream].written; }
+	uint64_t get_dropped(int stream) const { return streams[stream].dropped; }
+	uint64_t get_encode_us() const { return encode_us; }
+	size_t get_pending() const { return q_encode.size(); }
+
+private:
+
+	struct Item
+	{
+		int stream;
+		Mat3b image;
+		uint64_t frame_id;
+		uint64_t stamp_us;
+		uint64_t time_usec;
+		string meta;
+
+		Item() : stream(0), frame_id(0), stamp_us(0), time_usec(0) {}
+	};
+
+	struct Stream
+	{
+		VideoWriter writer;
+		ofstream index;
+		Size size;
+		std::atomic<uint64_t> written;
+		std::atomic<uint64_t> dropped;
+
+		Stream() : written(0), dropped(0) {}
+	};
+
+	void encode_thread();
+
+	bool block;
+	vector<Item> items;
+	SPSC_Queue<Item*> q_free;               // 编码线程 -> submit
+	SPSC_Queue<Item*> q_encode;             // submit -> 编码线程
+
+	Stream streams[RECORD_STREAM_NUM];
+	std::atomic<uint64_t> encode_us;
+	std::atomic<std::thread::id> producer;  // 第一次调用submit的线程
+
+	std::thread thread_encode;
+};
+
+#endif // VIDEO_RECORDER_H_
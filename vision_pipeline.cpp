@@ -0,0 +1,600 @@
+/**
+ * @file vision_pipeline.cpp
+ *
+ * @brief Staged vision processing
+ *
+ * The stage bodies are the former videothread loop, split where a frame can
+ * be handed over. CEllipseDetectorYaed is shared by the detect stage (Detect,
+ * color filter) and the classify stage (DrawDetectedEllipses, extracrROI);
+ * the two touch disjoint members.
+ *
+ */
+
+#include "vision_pipeline.h"
+
+// ------------------------------------------------------------------------------
+//   Frame
+// ------------------------------------------------------------------------------
+void
+Vision_Frame::
+reset()
+{
+	id = 0;
+	stamp_us = 0;
+	preprocess_us = detect_us = classify_us = update_us = sink_us = 0;
+	skipped = 0;
+	log_us = 0;
+	getlocalposition = stable = drop = false;
+	ellsYaed.clear();
+	ellipse_big.clear();
+	ellipse_out.clear();
+	ellipse_TF.clear();
+	ellipse_out1.clear();
+	img_roi.clear();
+	contours.clear();
+	targets.clear();
+	targets_T.clear();
+	targets_F.clear();
+	target_num = 0;
+	work = Work_Resolution();
+}
+
+int
+Vision_Frame::
+count_reallocs()
+{
+	// image与采集的三缓冲交换，每帧换一块缓冲区属于正常轮转，不在此统计
+	const uchar *data[4] = { image_r.data, gray.data, resultImage.data, full.data };
+	int n = 0;
+	for (int i = 0; i < 4; i++) {
+		if (data_prev[i] && data[i] && data[i] != data_prev[i])
+			n++;
+		if (data[i])
+			data_prev[i] = data[i];
+	}
+	return n;
+}
+
+// ------------------------------------------------------------------------------
+//   Frame Pool
+// ------------------------------------------------------------------------------
+Frame_Pool::
+Frame_Pool(size_t count) :
+	free_list(count)
+{
+	for (size_t i = 0; i < count; i++) {
+		frames.push_back(new Vision_Frame);
+		free_list.try_push(frames.back());
+	}
+}
+
+Frame_Pool::
+~Frame_Pool()
+{
+	for (size_t i = 0; i < frames.size(); i++)
+		delete frames[i];
+}
+
+Vision_Frame *
+Frame_Pool::
+acquire()
+{
+	Vision_Frame *frame = NULL;
+	if (!free_list.pop(frame))
+		return NULL;
+	return frame;
+}
+
+void
+Frame_Pool::
+release(Vision_Frame *frame)
+{
+	frame->reset();
+	free_list.push(frame);
+}
+
+// ------------------------------------------------------------------------------
+//   Con/De structors
+// ------------------------------------------------------------------------------
+Vision_Pipeline::
+Vision_Pipeline(Autopilot_Interface &api_, Frame_Source &source_, CEllipseDetectorYaed *yaed_,
+                CCandidateFilterChain &filter_chain_, const CandidateFilterParams &filter_params,
+                bool roi_threshold_, size_t depth) :
+	api(api_), source(source_), yaed(yaed_), filter_chain(filter_chain_), roi_threshold(roi_threshold_), record(true), show(false), recorder(NULL),
+	grabber(source_), replay_clock(NULL), q_preprocess(depth), q_detect(depth), q_classify(depth), q_sink(depth),
+	pool(4 * depth + 5),                    // 四个队列装满且每个阶段各持有一帧
+	log_file("frames.flog"), log_capacity(36000), summary_us(1000000), last_summary_us(0),
+	start_us(0), age_sum_us(0), reallocs(0), full_decodes(0), full_decode_us(0), stale_frames(0), time_to_exit(false)
+{
+	BuildCandidateFilters(filter_chain, yaed, filter_params, filter_frame);
+	/***************************尺寸先验：半长轴与按高度预计的目标半径相符********************************************/
+	filter_chain.AddStage("size", 0.5f, [this](const Ellipse& e){
+		return Resolution_Policy::accept_size(detect_work, resolution.get_params(), e._a);
+	});
+
+	const char *names[STAGE_NUM] = { "capture", "preprocess", "detect", "classify", "sink" };
+	for (int i = 0; i < STAGE_NUM; i++)
+		stats[i].name = names[i];
+	stats[STAGE_PREPROCESS].queue_capacity = q_preprocess.capacity();
+	stats[STAGE_DETECT].queue_capacity = q_detect.capacity();
+	stats[STAGE_CLASSIFY].queue_capacity = q_classify.capacity();
+	stats[STAGE_SINK].queue_capacity = q_sink.capacity();
+}
+
+// ------------------------------------------------------------------------------
+//   Run / Stop
+// ------------------------------------------------------------------------------
+void
+Vision_Pipeline::
+run()
+{
+	if (frame_log.open(log_file.c_str(), log_capacity))
+		frame_log.start();
+	recorder = new Video_Recorder(record_params.slots, record_params.block);
+	if (record)
+		recorder->open(RECORD_OVERLAY, "小图.avi", record_params.fps, Size(640, 360));
+	if (record_params.raw_every > 0) {
+		double scale = record_params.raw_scale;
+		int width = source.size().width, height = source.size().height;
+		if (width <= 0 || height <= 0) {
+			width = 1920;
+			height = 1080;
+		}
+		recorder->open(RECORD_RAW, "原图.avi", record_params.fps / record_params.raw_every,
+		               Size(cvRound(width * scale), cvRound(height * scale)));
+	}
+	recorder->start();
+	start_us = get_time_usec();
+
+	thread t_capture(&Vision_Pipeline::capture_stage, this);
+	thread t_preprocess(&Vision_Pipeline::preprocess_stage, this);
+	thread t_detect(&Vision_Pipeline::detect_stage, this);
+	thread t_classify(&Vision_Pipeline::classify_stage, this);
+	thread t_sink(&Vision_Pipeline::sink_stage, this);
+
+	t_capture.join();
+	t_preprocess.join();
+	t_detect.join();
+	t_classify.join();
+	t_sink.join();
+
+	recorder->stop();
+	frame_log.stop();
+	print_stats(cout);
+	delete recorder;
+	recorder = NULL;
+}
+
+void
+Vision_Pipeline::
+stop()
+{
+	time_to_exit = true;
+	pacer.stop();
+	grabber.interrupt();                    // 采集阶段结束时自己join采集线程
+	pool.close();
+}
+
+bool
+Vision_Pipeline::
+pop(SPSC_Queue<Vision_Frame*> &queue, Vision_Frame *&frame, int stage)
+{
+	stats[stage].queue_sum += queue.size();
+	return queue.pop(frame);
+}
+
+void
+Vision_Pipeline::
+add_busy(int stage, uint64_t t0)
+{
+	stats[stage].busy_us += get_time_usec() - t0;
+	stats[stage].frames++;
+}
+
+// ------------------------------------------------------------------------------
+//   Capture
+// ------------------------------------------------------------------------------
+void
+Vision_Pipeline::
+capture_stage()
+{
+	uint64_t id = 0, seq;
+	grabber.start();
+	while (!time_to_exit) {
+		Vision_Frame *frame = pool.acquire();
+		if (frame == NULL)
+			break;
+		//设置了目标帧率时等到下一帧的时刻，取此时最新的一帧；其间没有新帧时才等待采集线程发布(条件变量唤醒)
+		//期间到达又被覆盖的帧计入skipped
+		//帧对象的image与三缓冲中的一块交换，不拷贝也不分配
+		uint64_t wait_start = get_monotonic_usec();
+		if (!pacer.wait_next())
+			break;
+		if (!grabber.take(frame->image, frame->encoded, frame->stamp_us, seq, frame->skipped, frame->log_us))
+			break;
+		pacer.frame_done(wait_start);
+		frame->id = id++;
+		stats[STAGE_CAPTURE].frames++;
+
+		if (!q_preprocess.push(frame))
+			break;
+	}
+	grabber.stop();
+	q_preprocess.close();
+}
+
+// ------------------------------------------------------------------------------
+//   Preprocess
+// ------------------------------------------------------------------------------
+void
+Vision_Pipeline::
+preprocess_stage()
+{
+	Vision_Frame *frame;
+	while (pop(q_preprocess, frame, STAGE_PREPROCESS)) {
+		uint64_t t0 = get_time_usec();
+		//压缩帧源已按比例缩小解码，这里只从缩小图再缩放到检测尺寸
+		resize(frame->image, frame->image_r, Size(640, 360), 0, 0, CV_INTER_LINEAR);
+		//高度越低目标越大，检测可以在更小的图上进行
+		frame->work = resolution.update(api.current_messages.local_position_ned, getlocalposition);
+		if (frame->work.level == 0)
+			cvtColor(frame->image_r, frame->gray, COLOR_BGR2GRAY);
+		else {
+			cvtColor(frame->image_r, gray_r, COLOR_BGR2GRAY);
+			resize(gray_r, frame->gray, frame->work.size, 0, 0, CV_INTER_AREA);
+		}
+		add_busy(STAGE_PREPROCESS, t0);
+		frame->preprocess_us = get_monotonic_usec();
+
+		if (!q_detect.push(frame))
+			break;
+	}
+	q_detect.close();
+}
+
+// ------------------------------------------------------------------------------
+//   Detect
+// ------------------------------------------------------------------------------
+void
+Vision_Pipeline::
+detect_stage()
+{
+	uint64_t frame_count = 0;
+	Vision_Frame *frame;
+	while (pop(q_detect, frame, STAGE_DETECT)) {
+		uint64_t t0 = get_time_usec();
+		if (frame->work.size != detect_work.size || frame->work.th_length != detect_work.th_length)
+			yaed->SetSizeParameters(frame->work.th_length, frame->work.center_distance,
+			                        frame->work.size != detect_work.size);
+		detect_work = frame->work;
+		yaed->Detect(frame->gray, frame->ellsYaed);
+		//检测结果换算回640*360，之后的过滤、ROI和定位不受工作分辨率影响
+		if (detect_work.scale != 1.f) {
+			float k = 1.f / detect_work.scale;
+			for (auto &e : frame->ellsYaed) {
+				e._xc *= k;
+				e._yc *= k;
+				e._a *= k;
+				e._b *= k;
+			}
+		}
+
+		frame->getlocalposition = getlocalposition;
+		frame->stable = stable;
+		frame->drop = drop;
+		if (frame->getlocalposition) {
+			//按任务阶段选择过滤步骤，廉价的判断在前，颜色判断在后
+			filter_frame = frame->image_r;
+			filter_chain.SetPhase(frame->drop ? "drop" : (frame->stable ? "recognize" : "search"));
+			filter_chain.Run(frame->ellsYaed, frame->ellipse_big);
+			stable_sort(frame->ellipse_big.begin(), frame->ellipse_big.end(),
+			            [](const Ellipse& l, const Ellipse& r) { return l._xc < r._xc; });//延x轴方向由小到大排序
+			if (++frame_count % 100 == 0 && summary_us)
+				filter_chain.PrintStats(cout);
+		}
+		add_busy(STAGE_DETECT, t0);
+		frame->detect_us = get_monotonic_usec();
+
+		if (!q_classify.push(frame))
+			break;
+	}
+	q_classify.close();
+}
+
+// ------------------------------------------------------------------------------
+//   Classify / Fuse
+// ------------------------------------------------------------------------------
+const Mat3b &
+Vision_Pipeline::
+full_resolution(Vision_Frame &frame)
+{
+	//压缩帧源只在需要高分辨率ROI的帧全分辨率解码，解码失败时退回缩小图
+	if (frame.encoded.empty())
+		return frame.image;
+	uint64_t t0 = get_time_usec();
+	bool ok = decode_full_frame(frame.encoded, frame.full);
+	full_decode_us += get_time_usec() - t0;
+	full_decodes++;
+	return ok ? frame.full : frame.image;
+}
+
+void
+Vision_Pipeline::
+classify_stage()
+{
+	Vision_Frame *frame;
+	while (pop(q_classify, frame, STAGE_CLASSIFY)) {
+		uint64_t t0 = get_time_usec();
+		//只在写视频时绘制，overlay为空时DrawDetectedEllipses只输出坐标
+		Mat3b no_overlay;
+		Mat3b &overlay = record ? frame->resultImage : no_overlay;
+		if (record)
+			frame->image_r.copyTo(frame->resultImage);
+		//任务标志在检测阶段复制，队列中的帧可能已过时(resultTF或任务线程改变了stable、drop)
+		//阶段不同的帧只绘制不更新目标，避免在任务推进后重新判定或添加目标
+		bool stale = frame->getlocalposition != getlocalposition || frame->stable != stable || frame->drop != drop;
+		if (frame->getlocalposition && stale) {
+			yaed->DrawDetectedEllipses(overlay, frame->ellipse_out, frame->ellipse_big);
+			stale_frames++;
+		} else if (frame->getlocalposition) {
+			if (!frame->drop) {
+				yaed->DrawDetectedEllipses(overlay, frame->ellipse_out, frame->ellipse_big);//绘制检测到的椭圆
+				if (frame->stable) {
+					const Mat3b &roi_image = full_resolution(*frame);
+					float roi_scale = float(roi_image.cols) / frame->image_r.cols;
+					yaed->extracrROI(roi_image, frame->ellipse_out, frame->img_roi, roi_threshold, roi_scale);//只处理目标附近的窗口
+					visual_rec_recognizer().SetRoiScale(roi_scale);
+					visual_rec_recognizer().SetRoiThreshold(yaed->GetRoiThreshold());//识别缓存按阈值分开
+					associate_targets(api, frame->ellipse_out, target_ellipse_position, target_grid, frame->stamp_us);//识别缓存按目标查找
+					uint16_t hdg = api.current_messages.global_position_int.hdg;
+					visual_rec_recognizer().SetHeading(hdg == UINT16_MAX ? 0.f : hdg / 100.f);//模板识别按航向旋转ROI
+					visual_rec(frame->img_roi, frame->ellipse_out, frame->ellipse_TF, frame->contours);//T和F的检测程序
+					frame->ellipse_out1 = frame->ellipse_TF;
+				} else
+					frame->ellipse_out1 = frame->ellipse_out;
+				frame->classify_us = get_monotonic_usec();
+				//只有本阶段写目标列表，上面的只读访问不加锁
+				std::lock_guard<std::mutex> lock(target_mutex);
+				possible_ellipse(api, frame->ellipse_out1, target_ellipse_position, target_grid, frame->stamp_us);
+
+				if (frame->stable) {
+					resultTF(api, target_ellipse_position, ellipse_T, ellipse_F);
+				}
+			} else {
+				yaed->DrawDetectedEllipses(overlay, frame->ellipse_out, frame->ellipse_big);//绘制检测到的椭圆
+				getdroptarget(api, droptarget, frame->ellipse_out);
+			}
+		}
+
+		frame->targets = target_ellipse_position;
+		frame->targets_T = ellipse_T;
+		frame->targets_F = ellipse_F;
+		frame->local_position = api.current_messages.local_position_ned;
+		frame->target_num = TargetNum;
+		frame->update_us = get_monotonic_usec();
+		if (frame->classify_us == 0)
+			frame->classify_us = frame->update_us;
+		//目标列表已按这一帧更新，之后发出的设定点以它为依据
+		if (frame->getlocalposition)
+			publish_vision_frame(frame->id, frame->stamp_us);
+		//回放快速模式：这一帧融合完成后才放行到它的时刻为止的遥测，
+		//后面的帧读到的位置、航向和任务状态与线程调度无关
+		if (replay_clock)
+			replay_clock->advance(frame->log_us);
+
+		add_busy(STAGE_CLASSIFY, t0);
+
+		//只在调试时显示窗口，窗口事件在同一线程处理(imshow复制图像)
+		if (show) {
+			for (size_t i = 0; i < frame->img_roi.size(); i++)
+				imshow("ROI", frame->img_roi[i]);
+			waitKey(1);
+		}
+		//ROI指向检测器复用的缓冲区，下一帧extracrROI时被覆盖，不随帧进入输出阶段
+		frame->img_roi.clear();
+
+		if (!q_sink.push(frame))
+			break;
+	}
+	q_sink.close();
+}
+
+// ------------------------------------------------------------------------------
+//   Sinks
+// ------------------------------------------------------------------------------
+static void
+add_log_target(Frame_Log_Record &record, const target &t, int kind)
+{
+	if (record.n_targets >= FRAME_LOG_MAX_TARGETS)
+		return;
+	Frame_Log_Target &l = record.targets[record.n_targets++];
+	l.locx = t.locx;
+	l.locy = t.locy;
+	l.possible = t.possbile;
+	l.logodds = t.logodds;
+	l.lat = t.lat;
+	l.lon = t.lon;
+	l.T_N = uint16_t(min(t.T_N, uint32_t(UINT16_MAX)));
+	l.F_N = uint16_t(min(t.F_N, uint32_t(UINT16_MAX)));
+	l.kind = int8_t(kind);
+	l.state = t.state;
+	l.num = uint16_t(min(max(t.num, 0), int(UINT16_MAX)));
+}
+
+static void
+add_log_targets(Frame_Log_Record &record, const vector<target> &targets, int kind)
+{
+	if (kind != FRAME_LOG_TARGET) {
+		record.n_total[kind] = uint16_t(min(targets.size(), size_t(UINT16_MAX)));
+		for (size_t i = 0; i < targets.size(); i++)
+			add_log_target(record, targets[i], kind);
+		return;
+	}
+	//已删除的目标留在列表中只为保持编号，不记录；确认的目标在前，记录数不够时先舍去暂定目标
+	size_t live = 0;
+	for (size_t i = 0; i < targets.size(); i++) {
+		if (targets[i].state == TRACK_CONFIRMED)
+			add_log_target(record, targets[i], kind);
+		live += targets[i].state != TRACK_DEAD;
+	}
+	for (size_t i = 0; i < targets.size(); i++) {
+		if (targets[i].state == TRACK_TENTATIVE)
+			add_log_target(record, targets[i], kind);
+	}
+	record.n_total[kind] = uint16_t(min(live, size_t(UINT16_MAX)));
+}
+
+// 二进制日志中的一帧，替代原来逐行写入cout和target_r.txt的文本
+static uint32_t
+since_capture(const Vision_Frame &frame, uint64_t us)
+{
+	return us > frame.stamp_us ? uint32_t(min(us - frame.stamp_us, uint64_t(UINT32_MAX))) : 0;
+}
+
+static void
+make_log_record(Frame_Log_Record &record, const Vision_Frame &frame, const Autopilot_Interface &api)
+{
+	memset(&record, 0, sizeof(record));
+	record.frame_id = frame.id;
+	record.stamp_us = frame.stamp_us;
+	record.time_usec = get_time_usec();
+	record.local_x = frame.local_position.x;
+	record.local_y = frame.local_position.y;
+	record.local_z = frame.local_position.z;
+	record.preprocess_us = since_capture(frame, frame.preprocess_us);
+	record.detect_us = since_capture(frame, frame.detect_us);
+	record.classify_us = since_capture(frame, frame.classify_us);
+	record.update_us = since_capture(frame, frame.update_us);
+	record.sink_us = since_capture(frame, frame.sink_us);
+	record.setpoint_frame_id = api.setpoint_frame_id;
+	record.setpoint_latency_us = uint32_t(min(uint64_t(api.setpoint_latency_us), uint64_t(UINT32_MAX)));
+	record.target_num = int16_t(frame.target_num);
+	record.flags = (frame.getlocalposition ? FRAME_LOG_LOCAL_POSITION : 0) |
+	               (frame.stable ? FRAME_LOG_STABLE : 0) |
+	               (frame.drop ? FRAME_LOG_DROP : 0) |
+	               (updateellipse ? FRAME_LOG_UPDATE_ELLIPSE : 0);
+	add_log_targets(record, frame.targets, FRAME_LOG_TARGET);
+	add_log_targets(record, frame.targets_T, FRAME_LOG_T);
+	add_log_targets(record, frame.targets_F, FRAME_LOG_F);
+}
+
+// 录像索引中一帧的检测信息
+static void
+format_record_meta(string &meta, const Vision_Frame &frame)
+{
+	char buf[64];
+	snprintf(buf, sizeof(buf), "%d,%d,%.3f,%.3f,%.3f,", frame.stable, frame.drop,
+	         frame.local_position.x, frame.local_position.y, frame.local_position.z);
+	meta = buf;
+	const vector<coordinate> &ells = (frame.stable && !frame.drop) ? frame.ellipse_out1 : frame.ellipse_out;
+	for (size_t i = 0; i < ells.size(); i++) {
+		snprintf(buf, sizeof(buf), "%s%.1f %.1f %d", i ? ";" : "", ells[i].x, ells[i].y, ells[i].flag);
+		meta += buf;
+	}
+}
+
+void
+Vision_Pipeline::
+sink_stage()
+{
+	Vision_Frame *frame;
+	Frame_Log_Record log_record;
+	while (pop(q_sink, frame, STAGE_SINK)) {
+		uint64_t t0 = get_time_usec();
+		frame->sink_us = get_monotonic_usec();
+		if (frame->getlocalposition)
+			update_latency.add(frame->update_us - frame->stamp_us);
+		make_log_record(log_record, *frame, api);
+		frame_log.append(log_record);
+
+		//控制台只定期输出一行概要
+		uint64_t now_us = get_monotonic_usec();
+		if (summary_us && now_us - last_summary_us >= summary_us) {
+			printf("frame %llu targets %d T %d F %d pos %.2f %.2f %.2f stable:%d drop:%d target_Num:%d\n",
+			       (unsigned long long)frame->id, (int)frame->targets.size(), (int)frame->targets_T.size(),
+			       (int)frame->targets_F.size(), frame->local_position.x, frame->local_position.y,
+			       frame->local_position.z, frame->stable, frame->drop, frame->target_num);
+			last_summary_us = now_us;
+		}
+		bool raw = record_params.raw_every > 0 && frame->id % record_params.raw_every == 0;
+		if (record || raw)
+			format_record_meta(record_meta, *frame);
+		//只拷贝进录像线程的缓冲区，编码不占用输出阶段
+		if (record)
+			recorder->submit(RECORD_OVERLAY, frame->resultImage, frame->id, frame->stamp_us, record_meta);
+		if (raw)
+			recorder->submit(RECORD_RAW, frame->image, frame->id, frame->stamp_us, record_meta);
+		add_busy(STAGE_SINK, t0);
+		age_sum_us += get_monotonic_usec() - frame->stamp_us;
+		reallocs += frame->count_reallocs();
+
+		if (frame->id % 100 == 99 && summary_us)
+			print_stats(cout);
+		pool.release(frame);
+	}
+}
+
+// ------------------------------------------------------------------------------
+//   Stats
+// ------------------------------------------------------------------------------
+void
+Vision_Pipeline::
+print_stats(ostream &os) const
+{
+	double wall_s = (get_time_usec() - start_us) / 1e6;
+	os << "vision pipeline " << wall_s << " s" << endl;
+	for (int i = 0; i < STAGE_NUM; i++) {
+		const Stage_Stats &s = stats[i];
+		uint64_t frames = s.frames;
+		double busy = wall_s > 0 ? s.busy_us / 1e6 / wall_s : 0.;
+		os << "  " << s.name
+		   << " fps = " << (wall_s > 0 ? frames / wall_s : 0.)
+		   << " busy = " << busy * 100 << "%"
+		   << " ms/frame = " << (frames ? s.busy_us / 1000. / frames : 0.);
+		if (s.queue_capacity)
+			os << " queue = " << (frames ? double(s.queue_sum) / frames : 0.) << "/" << s.queue_capacity;
+		os << endl;
+	}
+	uint64_t sunk = stats[STAGE_SINK].frames;
+	os << "  paced fps = " << pacer.get_fps() << " idle = " << pacer.get_idle() * 100 << "%" << endl;
+	os << "  camera frames = " << grabber.get_captured()
+	   << " skipped = " << grabber.get_skipped()
+	   << " age at sink = " << (sunk ? age_sum_us / 1000. / sunk : 0.) << " ms" << endl;
+	os << "  frame pool = " << pool.size() << " image reallocs = " << reallocs
+	   << " stale phase frames = " << stale_frames << endl;
+	if (resolution.get_levels() > 1) {
+		os << "  resolution switches = " << resolution.get_switches() << " frames";
+		for (int i = 0; i < resolution.get_levels(); i++)
+			os << " " << resolution.get_params().widths[i] << ":" << resolution.get_frames(i);
+		os << endl;
+	}
+	if (source.decode_scale() > 1) {
+		uint64_t n = full_decodes;
+		os << "  decode scale = 1/" << source.decode_scale()
+		   << " full decodes = " << n
+		   << " ms/decode = " << (n ? full_decode_us / 1000. / n : 0.) << endl;
+	}
+	char buf[96];
+	update_latency.format(buf, sizeof(buf));
+	os << "  capture->target update " << buf << endl;
+	api.setpoint_latency.format(buf, sizeof(buf));
+	os << "  capture->setpoint " << buf << " last frame = " << api.setpoint_frame_id << endl;
+	const TFRecStats& rec = visual_rec_stats();
+	os << "  TF recognition rois = " << rec.uRois
+	   << " rois/s (recognition busy time) = " << (rec.dTimeMs > 0 ? rec.uRois * 1000. / rec.dTimeMs : 0.)
+	   << " cache hits = " << rec.uCacheHits
+	   << " roi pixels = " << yaed->GetRoiPixels()
+	   << " rss = " << get_rss_kb() << " kB" << endl;
+	os << "  tracks born = " << target_tracker.get_births()
+	   << " confirmed = " << target_tracker.get_confirms()
+	   << " deleted = " << target_tracker.get_deaths() << endl;
+	os << "  frame log written = " << frame_log.get_written() << " dropped = " << frame_log.get_dropped() << endl;
+	if (recorder) {
+		os << "  recorder overlay = " << recorder->get_written(RECORD_OVERLAY)
+		   << " dropped = " << recorder->get_dropped(RECORD_OVERLAY)
+		   << " raw = " << recorder->get_written(RECORD_RAW)
+		   << " dropped = " << recorder->get_dropped(RECORD_RAW)
+		   << " pending = " << recorder->get_pending()
+		   << " encode ms = " << recorder->get_encode_us() / 1000. << endl;
+	}
+}
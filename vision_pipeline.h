@@ -0,0 +1,236 @@
+/**
+ * @file vision_pipeline.h
+ *
+ * @brief Staged vision processing
+ *
+ * capture -> preprocess -> detect -> classify/fuse -> sinks, one thread per
+ * stage, connected by bounded SPSC queues. A full queue blocks the stage
+ * before it, so throughput is set by the slowest stage instead of the sum
+ * of all of them.
+ *
+ */
+
+#ifndef VISION_PIPELINE_H_
+#define VISION_PIPELINE_H_
+
+#include <thread>
+#include <atomic>
+#include <fstream>
+#include <iostream>
+
+#include "autopilot_interface.h"
+#include "spsc_queue.h"
+#include "frame_grabber.h"
+#include "frame_pacer.h"
+#include "video_recorder.h"
+#include "frame_log.h"
+#include "resolution_policy.h"
+#include "ellipse/TFRecognizer.h"
+
+// ------------------------------------------------------------------------------
+//   一帧在各阶段之间传递的数据
+// ------------------------------------------------------------------------------
+struct Vision_Frame
+{
+	uint64_t id;
+	uint64_t stamp_us;                      // 采集时刻(单调时钟)
+	// 各阶段完成时刻(单调时钟)，update_us为目标列表更新完成
+	uint64_t preprocess_us, detect_us, classify_us, update_us, sink_us;
+	uint64_t skipped;                       // 与上一帧之间被丢弃的相机帧数
+	uint64_t log_us;                        // 回放时记录的采集时刻，否则为0
+
+	Mat3b image;                            // 原图 1920*1080，压缩帧源为按比例缩小解码的图
+	Mat1b encoded;                          // 压缩帧源的JPEG数据(映射内存上的Mat头)，其他帧源为空
+	Mat3b full;                             // 压缩帧源需要高分辨率ROI时全分辨率解码的原图
+	Mat3b image_r;                          // 缩小图 640*360，颜色过滤和绘制使用
+	Mat1b gray;                             // 检测用的灰度图，尺寸为work.size
+	Work_Resolution work;                   // 预处理阶段按高度选择的工作分辨率和检测参数
+	Mat3b resultImage;                      // 绘制检测结果，只在需要写视频时绘制
+
+	// 检测阶段读取的任务状态，后续阶段按同一状态处理这一帧
+	bool getlocalposition;
+	bool stable;
+	bool drop;
+
+	vector<Ellipse> ellsYaed, ellipse_big;
+	vector<coordinate> ellipse_out, ellipse_TF, ellipse_out1;
+	vector<Mat1b> img_roi;                  // 检测器缓冲区上的Mat头，只在融合阶段内有效
+	vector<vector<Point> > contours;
+
+	// 融合阶段结束时的目标列表和位置，输出阶段只读这份拷贝
+	vector<target> targets, targets_T, targets_F;
+	mavlink_local_position_ned_t local_position;
+	int target_num;
+
+	Vision_Frame() : id(0), stamp_us(0), preprocess_us(0), detect_us(0), classify_us(0), update_us(0), sink_us(0), skipped(0), log_us(0), getlocalposition(false), stable(false), drop(false), target_num(0)
+	{
+		for (int i = 0; i < 4; i++)
+			data_prev[i] = NULL;
+	}
+
+	// 回收前清空结果，vector保留容量，图像保留缓冲区
+	void reset();
+
+	// image_r、gray、resultImage、full中缓冲区被重新分配的个数(第一次使用不计)
+	int count_reallocs();
+
+private:
+	const uchar *data_prev[4];
+};
+
+// ------------------------------------------------------------------------------
+//   帧对象池：启动时分配，输出阶段用完后放回空闲队列，由采集阶段取用
+// ------------------------------------------------------------------------------
+class Frame_Pool
+{
+public:
+
+	explicit Frame_Pool(size_t count);
+	~Frame_Pool();
+
+	// 等待空闲帧，池关闭后返回NULL
+	Vision_Frame *acquire();
+
+	// 只由输出阶段调用(空闲队列为单生产者单消费者)
+	void release(Vision_Frame *frame);
+
+	void close() { free_list.close(); }
+	size_t available() const { return free_list.size(); }
+	size_t size() const { return frames.size(); }
+
+private:
+
+	vector<Vision_Frame*> frames;
+	SPSC_Queue<Vision_Frame*> free_list;
+};
+
+// ------------------------------------------------------------------------------
+//   各阶段统计
+// ------------------------------------------------------------------------------
+struct Stage_Stats
+{
+	const char *name;
+	std::atomic<uint64_t> frames;
+	std::atomic<uint64_t> busy_us;          // 处理耗时，不含在队列上的等待
+	std::atomic<uint64_t> queue_sum;        // 每次取帧时输入队列的长度之和
+	size_t queue_capacity;
+
+	Stage_Stats() : name(""), frames(0), busy_us(0), queue_sum(0), queue_capacity(0) {}
+};
+
+enum {
+	STAGE_CAPTURE = 0,
+	STAGE_PREPROCESS,
+	STAGE_DETECT,
+	STAGE_CLASSIFY,
+	STAGE_SINK,
+	STAGE_NUM
+};
+
+// ------------------------------------------------------------------------------
+//   Vision Pipeline
+// ------------------------------------------------------------------------------
+class Vision_Pipeline
+{
+public:
+
+	// depth: 各阶段之间队列的长度；为1时每个阶段最多有一帧在等待，
+	// 采集阶段在队列有空位时才从采集线程取最新帧，不会处理排队的旧帧
+	Vision_Pipeline(Autopilot_Interface &api_, Frame_Source &source_, CEllipseDetectorYaed *yaed_,
+	                CCandidateFilterChain &filter_chain_, const CandidateFilterParams &filter_params,
+	                bool roi_threshold_, size_t depth = 1);
+
+	// 回放录像，须在run()之前调用
+	// 快速模式下融合阶段处理完一帧才把遥测放行到该帧的时刻，结果与线程调度无关
+	void set_replay(Replay_Clock *clock, const Replay_Frame_Times &times)
+	{
+		replay_clock = clock;
+		grabber.set_replay(clock, times);
+	}
+
+	// 录像设置，不录小图时各阶段不做任何绘制
+	void set_recording(const Record_Params &params) { record_params = params; record = params.overlay; }
+
+	// 启动各阶段线程，阻塞到视频结束或stop()
+	void run();
+	void stop();
+
+	// fps: 目标帧率，0为相机送来一帧处理一帧；show: 显示ROI窗口(调试用，需要显示器)
+	void set_pacing(double fps, bool show_) { pacer.set_rate(fps); show = show_; }
+
+	// 按高度选择检测的工作分辨率，须在run()之前调用
+	void set_resolution(const Resolution_Params &params) { resolution.set_params(params); }
+
+	// 每帧的目标列表写入二进制日志(tools/frame_log_decode解码)，控制台每summary_s秒输出一行概要
+	void set_log(const string &file, uint32_t capacity, double summary_s)
+	{
+		log_file = file;
+		log_capacity = capacity;
+		summary_us = uint64_t(summary_s * 1e6);
+	}
+
+	// 各阶段帧率、占用率及队列平均长度
+	void print_stats(ostream &os) const;
+	// 输出阶段处理完的帧数
+	uint64_t frames_out() const { return stats[STAGE_SINK].frames; }
+
+private:
+
+	void capture_stage();
+	void preprocess_stage();
+	void detect_stage();
+	void classify_stage();
+	void sink_stage();
+
+	// 提取ROI用的原分辨率图像，压缩帧源在此时才全分辨率解码
+	const Mat3b &full_resolution(Vision_Frame &frame);
+
+	// 从输入队列取帧并记录队列长度
+	bool pop(SPSC_Queue<Vision_Frame*> &queue, Vision_Frame *&frame, int stage);
+	void add_busy(int stage, uint64_t t0);
+
+	Autopilot_Interface &api;
+	Frame_Source &source;
+	CEllipseDetectorYaed *yaed;
+	CCandidateFilterChain &filter_chain;
+	bool roi_threshold;
+	bool record;
+	bool show;
+
+	// 颜色过滤步骤使用的当前帧(BuildCandidateFilters中按引用捕获)
+	Mat3b filter_frame;
+
+	// 预处理阶段选择工作分辨率，检测阶段按帧中的设置调整检测参数和尺寸先验
+	Resolution_Policy resolution;
+	Mat1b gray_r;                           // 预处理阶段 640*360的灰度图
+	Work_Resolution detect_work;            // 检测阶段当前使用的设置
+
+	// 采集线程只保留最新一帧
+	Frame_Grabber grabber;
+	Frame_Pacer pacer;
+	Replay_Clock *replay_clock;
+
+	SPSC_Queue<Vision_Frame*> q_preprocess, q_detect, q_classify, q_sink;
+	Frame_Pool pool;
+
+	Stage_Stats stats[STAGE_NUM];
+	uint64_t start_us;
+	std::atomic<uint64_t> age_sum_us;       // 输出阶段时帧的年龄(采集到输出)之和
+	std::atomic<uint64_t> reallocs;         // 稳定运行后应为0
+	std::atomic<uint64_t> full_decodes;     // 压缩帧源按需全分辨率解码的帧数及耗时
+	std::atomic<uint64_t> full_decode_us;
+	std::atomic<uint64_t> stale_frames;     // 检测后任务阶段已改变、不再更新目标的帧数
+	Latency_Histogram update_latency;       // 采集到目标列表更新
+	std::atomic<bool> time_to_exit;
+
+	Frame_Log frame_log;
+	string log_file;
+	uint32_t log_capacity;
+	uint64_t summary_us;
+	uint64_t last_summary_us;
+	Record_Params record_params;
+	Video_Recorder *recorder;               // 编码和写盘在录像线程中进行
+	string record_meta;
+};
+
+#endif // VISION_PIPELINE_H_